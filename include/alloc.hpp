@@ -0,0 +1,126 @@
+#pragma once
+#include <new>
+#include <atomic>
+#include <array>
+#include <mutex>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+
+// HEAP ALLOCATIONS
+// every operator new in the program is counted, in total for frame counters and per thread for phases
+std::atomic<unsigned long> heap_allocations{0};
+std::atomic<unsigned long> heap_bytes{0};
+thread_local unsigned long thread_allocations = 0;
+thread_local unsigned long thread_bytes = 0;
+
+void* counted_allocation(std::size_t size) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    heap_bytes.fetch_add(size, std::memory_order_relaxed);
+    ++thread_allocations;
+    thread_bytes += size;
+    void* block = std::malloc(size > 0 ? size : 1);
+    if (block == NULL) { throw std::bad_alloc(); }
+    return block;
+}
+
+void* operator new(std::size_t size) { return counted_allocation(size); }
+void* operator new[](std::size_t size) { return counted_allocation(size); }
+void operator delete(void* block) noexcept { std::free(block); }
+void operator delete[](void* block) noexcept { std::free(block); }
+void operator delete(void* block, std::size_t) noexcept { std::free(block); }
+void operator delete[](void* block, std::size_t) noexcept { std::free(block); }
+
+// phases are trace zone names, the table is fixed so tracking does not allocate itself
+const int MAX_ALLOCATION_PHASES = 64;
+
+// frames after start up before allocations count against steady state
+const unsigned long ALLOCATION_WARMUP_FRAMES = FPS_CAP;
+
+struct allocation_phase {
+    const char* name;
+    unsigned long calls;
+    unsigned long allocations;
+    unsigned long bytes;
+};
+
+class allocation_tracker {
+    private:
+        bool enabled;
+
+        std::mutex phases_mutex;
+        std::array<allocation_phase, MAX_ALLOCATION_PHASES> phases;
+        int phase_count;
+
+        // gameplay frames checked and those that allocated
+        unsigned long steady_frames;
+        unsigned long allocating_frames;
+        unsigned long first_allocating_frame;
+        unsigned long steady_allocations;
+
+    public:
+        allocation_tracker();
+
+        // start attributing allocations to phases
+        void enable();
+        bool is_enabled() const;
+
+        // add allocations made inside one run of a phase, nested phases are counted in their parents too
+        void record_phase(const char* name, unsigned long allocations, unsigned long bytes);
+
+        // count a frame's allocations against steady state
+        void check_frame(bool steady, unsigned long frame, unsigned long allocations);
+
+        // no steady state frame allocated
+        bool passed() const;
+
+        // print allocations per phase and steady state frames that allocated
+        void report(std::ostream &out);
+};
+
+allocation_tracker allocations;
+
+// ALLOCATION TRACKER CLASS
+allocation_tracker::allocation_tracker() {
+    enabled = false;
+    phase_count = 0;
+    steady_frames = 0;
+    allocating_frames = 0;
+    first_allocating_frame = 0;
+    steady_allocations = 0;
+}
+void allocation_tracker::enable() { enabled = true; }
+bool allocation_tracker::is_enabled() const { return enabled; }
+void allocation_tracker::record_phase(const char* name, unsigned long allocations, unsigned long bytes) {
+    std::lock_guard<std::mutex> lock(phases_mutex);
+    int p = 0;
+    while (p < phase_count && std::strcmp(phases[p].name, name) != 0) { ++p; }
+    if (p == phase_count) {
+        if (phase_count == MAX_ALLOCATION_PHASES) { return; }
+        phases[phase_count++] = allocation_phase{name, 0, 0, 0};
+    }
+    ++phases[p].calls;
+    phases[p].allocations += allocations;
+    phases[p].bytes += bytes;
+}
+void allocation_tracker::check_frame(bool steady, unsigned long frame, unsigned long allocations) {
+    if (!enabled || !steady || frame <= ALLOCATION_WARMUP_FRAMES) { return; }
+    ++steady_frames;
+    if (allocations > 0) {
+        if (allocating_frames == 0) { first_allocating_frame = frame; }
+        ++allocating_frames;
+        steady_allocations += allocations;
+    }
+}
+bool allocation_tracker::passed() const { return allocating_frames == 0; }
+void allocation_tracker::report(std::ostream &out) {
+    std::lock_guard<std::mutex> lock(phases_mutex);
+    out << "heap allocations per phase:" << std::endl;
+    for (int p = 0; p < phase_count; ++p) {
+        out << "  " << std::left << std::setw(24) << phases[p].name << std::right << std::setw(10) << phases[p].calls << " runs" << std::setw(10) << phases[p].allocations << " allocations" << std::setw(12) << phases[p].bytes << " bytes" << std::endl;
+    }
+    out << "steady state frames: " << steady_frames << ", " << allocating_frames << " allocated";
+    if (allocating_frames > 0) { out << " (" << steady_allocations << " allocations, first at frame " << first_allocating_frame << ")"; }
+    out << std::endl;
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <vector>
+#include <limits>
+#include <cmath>
+#include <cstdlib>
+
+// AUTOPLAY
+// -autoplay plays with nobody at the controls, for soak tests watched by the soak monitor
+// walls go on the sampled open cell farthest from every ball, across the line to the nearest one
+// level complete and pauses are dismissed after a moment, and the game starts over once the endgame has flashed for a while
+
+// open cells sampled per wall
+const unsigned int AUTOPLAY_CANDIDATES = 16;
+
+// frames a paused scene is shown before it is dismissed, and the endgame before starting over
+const unsigned long AUTOPLAY_DISMISS_FRAMES = FPS_CAP / 2;
+const unsigned long AUTOPLAY_RESTART_FRAMES = 2 * FPS_CAP;
+
+class autoplay_agent {
+    private:
+        // scene on the last frame and frames spent in it
+        scene last_scene;
+        unsigned long scene_frames;
+
+    public:
+        autoplay_agent();
+
+        // play the frame's input before the scenes run
+        void play(scene_context &ctx);
+};
+
+bool autoplay_place(simulation &sim) {
+    // place a wall where the heuristic picks, returns false if nothing was placed
+    if (!sim.walls_to_build_black.empty() || !sim.walls_to_build_white.empty() || sim.balls_list.empty()) { return false; }
+    const int cols = sim.grid.size();
+    const int rows = sim.grid[0].size();
+
+    float farthest = -1;
+    int best_col = 0, best_row = 0;
+    orientation best_orientation = orientation::vertical;
+    for (unsigned int n = 0; n < AUTOPLAY_CANDIDATES; ++n) {
+        const int col = std::rand() % cols;
+        const int row = std::rand() % rows;
+        if (sim.grid[col][row].built || sim.grid[col][row].active) { continue; }
+
+        // nearest ball to the centre of the cell
+        const float x = GRID_X_OFFSET + col*GRID_DIM + GRID_DIM / 2.0f;
+        const float y = GRID_Y_OFFSET + row*GRID_DIM + GRID_DIM / 2.0f;
+        float nearest = std::numeric_limits<float>::max();
+        float dx = 0, dy = 0;
+        for (const ball &b : sim.balls_list) {
+            const float bx = b.x_pos + b.rad / 2.0f - x;
+            const float by = b.y_pos + b.rad / 2.0f - y;
+            if (bx*bx + by*by < nearest) {
+                nearest = bx*bx + by*by;
+                dx = bx;
+                dy = by;
+            }
+        }
+        if (nearest > farthest) {
+            farthest = nearest;
+            best_col = col;
+            best_row = row;
+            best_orientation = (std::abs(dx) > std::abs(dy)) ? orientation::vertical : orientation::horizontal;
+        }
+    }
+    return (farthest >= 0) && place_wall(sim, best_col, best_row, best_orientation);
+}
+
+void autoplay_restart(scene_context &ctx) {
+    // start over from the starting level, as if the game was launched again
+    ctx.scenes.stop();
+    ctx.history.stop_scrubbing();
+    start_level(ctx.parameters, ctx.sim, ctx.parameters.LEVEL_SELECT);
+    ctx.sim.build_timer.start();
+    ctx.wall_orientation = orientation::vertical;
+    ctx.screen_overlay = overlay::none;
+    ctx.scenes.start(run_scenes(ctx));
+}
+
+// AUTOPLAY AGENT CLASS
+autoplay_agent::autoplay_agent() {
+    last_scene = scene::playing;
+    scene_frames = 0;
+}
+void autoplay_agent::play(scene_context &ctx) {
+    const scene current = ctx.scenes.current_scene();
+    if (current != last_scene) {
+        if (current == scene::level_complete) { soak.count_level(); }
+        if (current == scene::won || current == scene::lost) { soak.count_game(); }
+        last_scene = current;
+        scene_frames = 0;
+    } else {
+        ++scene_frames;
+    }
+
+    switch (current) {
+        case scene::playing:
+            autoplay_place(ctx.sim);
+            break;
+        case scene::paused:
+        case scene::level_complete:
+            if (scene_frames == AUTOPLAY_DISMISS_FRAMES) { ctx.resume = true; }
+            break;
+        case scene::won:
+        case scene::lost:
+            if (scene_frames == AUTOPLAY_RESTART_FRAMES) { autoplay_restart(ctx); }
+            break;
+        default:
+            break;
+    }
+}
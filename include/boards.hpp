@@ -0,0 +1,400 @@
+#pragma once
+#include "SDL/SDL.h"
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <exception>
+#include <cmath>
+#include <iostream>
+
+// TILED BOARDS
+// -boards plays several independent games in one window, each in a tile with its own state, scenes and events
+// boards run their frames and are scaled into their tiles on a pool of worker threads, compositing stays on the main thread
+// since SDL 1.2 keeps the blit mapping of a sprite on the sprite, which every board draws
+// clicks go to the board under the cursor, which then gets the keys too, focus changes and quitting go to every board
+// the camera is shared, so boards stay unzoomed and its buttons and keys are not passed on
+
+// events a board takes in a frame before its queue allocates
+const std::size_t BOARD_EVENTS_RESERVED = 64;
+
+class worker_pool {
+    // threads that share out the jobs of each run, the calling thread takes jobs too
+    private:
+        std::vector<std::thread> workers;
+        std::mutex jobs_mutex;
+        std::condition_variable jobs_ready, jobs_done;
+
+        // jobs of the current run, handed out by index
+        const std::function<void(std::size_t)>* job;
+        std::size_t jobs;
+        std::atomic<std::size_t> next_job;
+
+        // runs started, and workers not yet done with the current one
+        unsigned long generation;
+        std::size_t busy;
+        bool running;
+
+        // first exception thrown by a job of the current run, rethrown on the calling thread
+        std::exception_ptr failure;
+
+        // worker thread body
+        void work_loop();
+        void take_jobs();
+
+    public:
+        worker_pool();
+        ~worker_pool();
+
+        // launch threads besides the calling one, and join them
+        void start(std::size_t threads);
+        void stop();
+
+        // run f(0) to f(count - 1) and return once all are done, rethrowing the first exception a job threw
+        void run(std::size_t count, const std::function<void(std::size_t)> &f);
+};
+
+struct board {
+    // one game and the tile it is shown in
+    simulation sim;
+    level_loader loader;
+    rewind_buffer history;
+    scene_scheduler scenes;
+    board_events events;
+    scene_context context;
+
+    // frame composited at 800x600 into surface, then scaled into the tile
+    snapshot frame;
+    SDL_Surface* surface;
+    scaler tile_scaler;
+    SDL_Rect tile;
+
+    // scene and level when the frame started, for the steady state check
+    scene scene_at_start;
+    unsigned int level_at_start;
+
+    board(const options &parameters);
+    ~board();
+
+    // spawn the starting level and set up the tile, false if the surface cannot be made
+    bool init(const options &parameters, const SDL_Rect &at);
+};
+
+// WORKER POOL CLASS
+worker_pool::worker_pool() {
+    job = NULL;
+    jobs = 0;
+    next_job = 0;
+    generation = 0;
+    busy = 0;
+    running = false;
+}
+worker_pool::~worker_pool() { stop(); }
+void worker_pool::start(std::size_t threads) {
+    if (running) { return; }
+    running = true;
+    for (std::size_t n = 0; n < threads; ++n) { workers.emplace_back(&worker_pool::work_loop, this); }
+}
+void worker_pool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        if (!running) { return; }
+        running = false;
+    }
+    jobs_ready.notify_all();
+    for (std::thread &worker : workers) { worker.join(); }
+    workers.clear();
+}
+void worker_pool::take_jobs() {
+    for (std::size_t n = next_job++; n < jobs; n = next_job++) {
+        try {
+            (*job)(n);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(jobs_mutex);
+            if (!failure) { failure = std::current_exception(); }
+        }
+    }
+}
+void worker_pool::work_loop() {
+    unsigned long seen = 0;
+    while (true) {
+        {
+            // wait for the next run
+            std::unique_lock<std::mutex> lock(jobs_mutex);
+            jobs_ready.wait(lock, [this, seen]{ return generation != seen || !running; });
+            if (!running) { return; }
+            seen = generation;
+        }
+        take_jobs();
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex);
+            if (--busy == 0) { jobs_done.notify_one(); }
+        }
+    }
+}
+void worker_pool::run(std::size_t count, const std::function<void(std::size_t)> &f) {
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        job = &f;
+        jobs = count;
+        next_job = 0;
+        busy = workers.size();
+        ++generation;
+    }
+    jobs_ready.notify_all();
+    take_jobs();
+
+    // every worker has to be done before f goes out of scope
+    std::unique_lock<std::mutex> lock(jobs_mutex);
+    jobs_done.wait(lock, [this]{ return busy == 0; });
+    if (failure) {
+        std::exception_ptr thrown = failure;
+        failure = nullptr;
+        std::rethrow_exception(thrown);
+    }
+}
+
+// BOARD CLASS
+board::board(const options &parameters) : context{.parameters = parameters, .sim = sim, .loader = loader, .history = history, .scenes = scenes, .events = &events} {
+    sim.game_state = {
+        .current_level = parameters.LEVEL_SELECT,
+        .current_lives = parameters.STARTING_LIVES,
+        .current_percentage = 0,
+        .quit = false,
+        .show_stats = false,
+        .frame = 0,
+        .trajectory_hash = TRAJECTORY_HASH_SEED,
+    };
+    surface = NULL;
+    tile = SDL_Rect{0, 0, 0, 0};
+    scene_at_start = scene::playing;
+    level_at_start = 0;
+}
+board::~board() {
+    scenes.stop();
+    loader.stop();
+    if (surface != NULL) { SDL_FreeSurface(surface); }
+}
+bool board::init(const options &parameters, const SDL_Rect &at) {
+    button_init(sim.grid);
+    level_storage_init(sim.grid, sim.walls_list, sim.walls_to_build_black, sim.walls_to_build_white, sim.walls_black_buffer, sim.walls_white_buffer, sim.balls_list);
+    ball_init(parameters, sim.game_state, sim.balls_list);
+    events.queue.reserve(BOARD_EVENTS_RESERVED);
+
+    // the rewind memory is split between the boards
+    const std::size_t balls = std::max<std::size_t>(sim.balls_list.capacity(), MAX_LEVEL);
+    history.init(parameters.REWIND_MEGABYTES / parameters.BOARDS, balls, sim.walls_list.capacity());
+    snapshot_reserve(frame, sim.walls_list.capacity(), balls);
+
+    tile = at;
+    if (parameters.INDEXED_RENDER) {
+        surface = screen_palette.create(SCREEN_WIDTH, SCREEN_HEIGHT);
+    } else {
+        const SDL_PixelFormat* format = window_surface->format;
+        surface = SDL_CreateRGBSurface(SDL_SWSURFACE, SCREEN_WIDTH, SCREEN_HEIGHT, SCREEN_BPP, format->Rmask, format->Gmask, format->Bmask, format->Amask);
+    }
+    if (surface == NULL) { return false; }
+    tile_scaler.init(SCREEN_WIDTH, SCREEN_HEIGHT, tile.w, tile.h, parameters.SCALE_FILTER);
+    tile_scaler.scale_every_tile(page_flipped(window_surface));
+    if (parameters.INDEXED_RENDER) { tile_scaler.set_palette(surface->format->palette, window_surface->format); }
+    return true;
+}
+
+SDL_Rect board_tile(std::size_t n, std::size_t boards, int width, int height) {
+    // boards in a grid as square as it gets, tiles keep the 4:3 frame and are centred in their cell
+    const std::size_t columns = std::size_t(std::ceil(std::sqrt(double(boards))));
+    const std::size_t rows = (boards + columns - 1) / columns;
+    const int cell_w = width / columns;
+    const int cell_h = height / rows;
+    const int tile_w = std::min(cell_w, cell_h * SCREEN_WIDTH / SCREEN_HEIGHT);
+    const int tile_h = tile_w * SCREEN_HEIGHT / SCREEN_WIDTH;
+    SDL_Rect tile;
+    tile.x = (n % columns) * cell_w + (cell_w - tile_w) / 2;
+    tile.y = (n / columns) * cell_h + (cell_h - tile_h) / 2;
+    tile.w = tile_w;
+    tile.h = tile_h;
+    return tile;
+}
+
+std::size_t board_at(const std::vector<std::unique_ptr<board>> &boards, int x, int y) {
+    // board whose tile holds a window point, or the number of boards if none does
+    for (std::size_t n = 0; n < boards.size(); ++n) {
+        const SDL_Rect &tile = boards[n]->tile;
+        if (x >= tile.x && x < tile.x + tile.w && y >= tile.y && y < tile.y + tile.h) { return n; }
+    }
+    return boards.size();
+}
+
+void boards_events(std::vector<std::unique_ptr<board>> &boards, std::size_t &focused) {
+    // hand each window event to the boards it is for
+    trace_zone zone("poll_events");
+    while (SDL_PollEvent(&event)) {
+        switch (event.type) {
+            case SDL_QUIT:
+            case SDL_ACTIVEEVENT:
+                for (std::unique_ptr<board> &b : boards) { b->events.queue.push_back(event); }
+                break;
+            case SDL_KEYDOWN:
+            case SDL_KEYUP:
+                if (event.key.keysym.sym != SDLK_HOME) { boards[focused]->events.queue.push_back(event); }
+                break;
+            case SDL_MOUSEBUTTONDOWN:
+            case SDL_MOUSEBUTTONUP: {
+                if (event.button.button != SDL_BUTTON_LEFT && event.button.button != SDL_BUTTON_RIGHT) { break; }
+                const std::size_t n = board_at(boards, event.button.x, event.button.y);
+                if (n == boards.size()) { break; }
+                if (event.type == SDL_MOUSEBUTTONDOWN) { focused = n; }
+
+                // from the window into the board's 800x600 frame
+                board &b = *boards[n];
+                event.button.x = b.tile_scaler.source_x(event.button.x - b.tile.x);
+                event.button.y = b.tile_scaler.source_y(event.button.y - b.tile.y);
+                b.events.queue.push_back(event);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+bool board_running(const board &b) { return !b.sim.game_state.quit && b.scenes.is_running(); }
+
+void board_frame(board &b) {
+    // run the board's scenes on its events, run on a worker
+    if (board_running(b)) { b.scenes.run_frame(); }
+    b.events.queue.clear();
+    b.events.read = 0;
+}
+
+void board_scale(board &b) {
+    // scale the board's frame into its tile, run on a worker with the window locked
+    Uint32* pixels = static_cast<Uint32*>(window_surface->pixels);
+    const int pitch = window_surface->pitch / 4;
+    b.tile_scaler.scale(b.surface, pixels + std::size_t(b.tile.y)*pitch + b.tile.x, pitch);
+}
+
+activity boards_activity(const std::vector<std::unique_ptr<board>> &boards) {
+    // the busiest board decides what the cpu meter charges the frame to
+    activity busiest = ACTIVITY_IDLE;
+    for (const std::unique_ptr<board> &b : boards) {
+        const activity current = scene_activity(b->scenes.current_scene());
+        if (current == ACTIVITY_RUNNING) { return current; }
+        if (current == ACTIVITY_ENDGAME) { busiest = current; }
+    }
+    return busiest;
+}
+
+bool boards_session(const options &parameters, frame_encoder &encoder) {
+    // play the boards until every one has quit, returns false on errors
+    const std::size_t count = parameters.BOARDS;
+
+    // clicks are mapped into the tiles here, not by the window scaler
+    screen_scaler.init(window_surface->w, window_surface->h, window_surface->w, window_surface->h, parameters.SCALE_FILTER);
+    SDL_Surface* logical_screen = screen;
+    SDL_FillRect(window_surface, NULL, 0x000000);
+
+    std::vector<std::unique_ptr<board>> boards;
+    for (std::size_t n = 0; n < count; ++n) {
+        boards.emplace_back(std::make_unique<board>(parameters));
+        if (!boards.back()->init(parameters, board_tile(n, count, window_surface->w, window_surface->h))) {
+            std::cerr << "error: could not create the surface of board " << n + 1 << std::endl;
+            return false;
+        }
+    }
+
+    // boards share the cores, the main thread takes boards too
+    const std::size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    worker_pool pool;
+    pool.start(std::min(count, cores) - 1);
+
+    timer frame_timer;
+    unsigned int start_time;
+    unsigned long frame = 0;
+    std::size_t focused = 0;
+
+    // GAME LOOP
+    try {
+        for (std::unique_ptr<board> &b : boards) {
+            b->sim.build_timer.start();
+            b->scenes.start(run_scenes(b->context));
+        }
+        while (std::any_of(boards.begin(), boards.end(), [](const std::unique_ptr<board> &b){ return board_running(*b); })) {
+            frame_timer.start();
+            start_time = SDL_GetTicks();
+            cpu.enter(boards_activity(boards));
+            for (std::unique_ptr<board> &b : boards) {
+                b->scene_at_start = b->scenes.current_scene();
+                b->level_at_start = b->sim.game_state.current_level;
+            }
+
+            // EVENTS, then each board's scenes on the pool
+            boards_events(boards, focused);
+            pool.run(count, [&boards](std::size_t n){ board_frame(*boards[n]); });
+            SDL_SetCursor((boards[focused]->context.wall_orientation == orientation::vertical) ? cursor_vertical : cursor_horizontal);
+
+            // RENDERING
+            // composite every board into its own frame, one after another
+            {
+                trace_zone zone("render_frame");
+                for (std::unique_ptr<board> &b : boards) {
+                    capture_snapshot(b->frame, b->sim.game_state, b->sim.walls_list, b->sim.balls_list, b->context.screen_overlay);
+                    if (b->history.is_scrubbing() && b->history.load(b->frame)) { b->frame.screen_overlay = overlay::none; }
+                    screen = b->surface;
+                    const bool composited = composite_frame(b->frame);
+                    screen = logical_screen;
+                    if (!composited) { throw std::runtime_error("SDL failed"); }
+                }
+            }
+
+            // scale them into their tiles at once, a page flipped window gets its borders cleared again as well
+            {
+                trace_zone zone("scale");
+                if (page_flipped(window_surface)) { SDL_FillRect(window_surface, NULL, 0x000000); }
+                if (SDL_MUSTLOCK(window_surface) && SDL_LockSurface(window_surface) == -1) { throw std::runtime_error("SDL failed"); }
+                pool.run(count, [&boards](std::size_t n){ board_scale(*boards[n]); });
+                if (SDL_MUSTLOCK(window_surface)) { SDL_UnlockSurface(window_surface); }
+            }
+            if (encoder.is_running() && !encoder.push(window_surface)) { throw std::runtime_error("could not export frame"); }
+            {
+                trace_zone zone("SDL_Flip");
+                if (SDL_Flip(window_surface) == -1) { throw std::runtime_error("SDL failed"); }
+            }
+
+            // close the frame for every board
+            stats.end_frame();
+            ++frame;
+            if (clock_fixed) { clock_step(frame); }
+            bool steady = true;
+            for (std::unique_ptr<board> &b : boards) {
+                b->sim.game_state.frame = frame;
+                if ((parameters.FRAME_LIMIT > 0) && (frame >= parameters.FRAME_LIMIT)) { b->sim.game_state.quit = true; }
+                steady = steady && (b->scene_at_start == scene::playing) && (b->scenes.current_scene() == scene::playing) && (b->sim.game_state.current_level == b->level_at_start);
+            }
+            allocations.check_frame(steady, frame, stats.last_frame()[HEAP_ALLOCATIONS]);
+
+            // cap fps, or wait for an event while no board moves
+            const bool idle = !parameters.HEADLESS && std::all_of(boards.begin(), boards.end(), [](const std::unique_ptr<board> &b){ return !board_running(*b) || b->scenes.is_idle(); });
+            fps_handle(parameters, frame_timer, start_time, idle);
+        }
+
+    // catch errors, including those a board threw on a worker, and leave the boards
+    } catch (const std::exception& e) {
+        screen = logical_screen;
+        std::cerr << e.what() << std::endl;
+        std::cerr << SDL_GetError() << std::endl;
+        return false;
+    }
+
+    // report trajectory hashes, one per board
+    if (parameters.FIXED_PHYSICS) {
+        for (std::size_t n = 0; n < count; ++n) {
+            const state &game_state = boards[n]->sim.game_state;
+            std::cout << "board " << n + 1 << " trajectory hash: " << std::hex << game_state.trajectory_hash << std::dec << " after " << game_state.frame << " frames" << std::endl;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,197 @@
+#pragma once
+#include "SDL/SDL.h"
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+// CAMERA
+// the playfield can be zoomed by whole steps and scrolled, the hud and overlays are drawn as they are
+// mouse wheel zooms on the cursor, dragging with the middle button scrolls, home shows the whole playfield again
+const int MAX_CAMERA_ZOOM = 8;
+
+// playfield in pixels and cells
+const int PLAYFIELD_WIDTH = SCREEN_WIDTH - 2*GRID_X_OFFSET;
+const int PLAYFIELD_HEIGHT = SCREEN_HEIGHT - 2*GRID_Y_OFFSET;
+const int PLAYFIELD_COLS = PLAYFIELD_WIDTH / GRID_DIM;
+const int PLAYFIELD_ROWS = PLAYFIELD_HEIGHT / GRID_DIM;
+
+// what a cell holds for a zoomed view
+enum cell_contents : unsigned char {
+    CELL_OPEN,
+    CELL_WHITE,
+    CELL_BLACK,
+};
+
+struct camera_view {
+    // zoom, and the playfield pixel drawn at the top left of the playfield
+    int zoom = 1;
+    int x = 0;
+    int y = 0;
+};
+
+class camera {
+    // view over the playfield, and the sprites drawn with it at each zoom
+    private:
+        camera_view current;
+
+        // playfield pixel held under the cursor while dragging
+        bool dragging;
+        int anchor_x, anchor_y;
+
+        // sprites scaled up for each zoom, zoom 1 draws the loaded images
+        std::array<SDL_Surface*, MAX_CAMERA_ZOOM + 1> balls;
+        std::array<SDL_Surface*, MAX_CAMERA_ZOOM + 1> walls_black;
+        std::array<SDL_Surface*, MAX_CAMERA_ZOOM + 1> walls_white;
+        std::array<SDL_Surface*, MAX_CAMERA_ZOOM + 1> open_cells;
+
+        void clamp();
+
+    public:
+        camera();
+
+        // scale the sprites, once the images are loaded
+        bool init();
+        void free();
+
+        const camera_view &view() const;
+        bool is_zoomed() const;
+
+        // zoom in by steps, out if negative, keeping the playfield pixel under the screen point in place
+        void zoom_at(int screen_x, int screen_y, int steps);
+        void reset();
+
+        // wheel, middle drag and home key
+        void handle(const SDL_Event &e);
+
+        // playfield pixel under a screen point, in unzoomed screen coordinates
+        int board_x(int screen_x) const;
+        int board_y(int screen_y) const;
+
+        SDL_Surface* ball_sprite(int zoom) const;
+        SDL_Surface* wall_sprite(int zoom, bool colour) const;
+        SDL_Surface* cell_sprite(int zoom) const;
+};
+
+camera screen_camera;
+
+SDL_Surface* zoom_surface(SDL_Surface* source, const SDL_Rect &clip, int zoom) {
+    // nearest neighbour copy of clip at zoom times its size, in the same pixel format and palette
+    const SDL_PixelFormat* format = source->format;
+    SDL_Surface* zoomed = SDL_CreateRGBSurface(SDL_SWSURFACE, clip.w*zoom, clip.h*zoom, format->BitsPerPixel, format->Rmask, format->Gmask, format->Bmask, format->Amask);
+    if (zoomed == NULL) { return NULL; }
+    if (format->palette != NULL) { SDL_SetColors(zoomed, format->palette->colors, 0, format->palette->ncolors); }
+    const int bytes = format->BytesPerPixel;
+    SDL_LockSurface(source);
+    SDL_LockSurface(zoomed);
+    for (int y = 0; y < zoomed->h; ++y) {
+        const Uint8* source_row = static_cast<const Uint8*>(source->pixels) + (clip.y + y/zoom)*source->pitch + clip.x*bytes;
+        Uint8* zoomed_row = static_cast<Uint8*>(zoomed->pixels) + y*zoomed->pitch;
+        for (int x = 0; x < zoomed->w; ++x) { std::memcpy(zoomed_row + x*bytes, source_row + (x/zoom)*bytes, bytes); }
+    }
+    SDL_UnlockSurface(zoomed);
+    SDL_UnlockSurface(source);
+    return zoomed;
+}
+
+// CAMERA CLASS
+camera::camera() {
+    dragging = false;
+    anchor_x = anchor_y = 0;
+    balls.fill(NULL);
+    walls_black.fill(NULL);
+    walls_white.fill(NULL);
+    open_cells.fill(NULL);
+}
+bool camera::init() {
+    SDL_Rect whole = {0, 0, Uint16(balls_surface->w), Uint16(balls_surface->h)};
+    SDL_Rect wall = {0, 0, Uint16(wall_black->w), Uint16(wall_black->h)};
+
+    // the playfield background repeats every cell
+    SDL_Rect cell = {GRID_X_OFFSET, GRID_Y_OFFSET, GRID_DIM, GRID_DIM};
+    for (int zoom = 2; zoom <= MAX_CAMERA_ZOOM; ++zoom) {
+        balls[zoom] = zoom_surface(balls_surface, whole, zoom);
+        walls_black[zoom] = zoom_surface(wall_black, wall, zoom);
+        walls_white[zoom] = zoom_surface(wall_white, wall, zoom);
+        open_cells[zoom] = zoom_surface(background_surface, cell, zoom);
+        if (!balls[zoom] || !walls_black[zoom] || !walls_white[zoom] || !open_cells[zoom]) { return false; }
+    }
+    return true;
+}
+void camera::free() {
+    for (std::array<SDL_Surface*, MAX_CAMERA_ZOOM + 1>* sprites : {&balls, &walls_black, &walls_white, &open_cells}) {
+        for (SDL_Surface* &sprite : *sprites) {
+            if (sprite != NULL) { SDL_FreeSurface(sprite); }
+            sprite = NULL;
+        }
+    }
+}
+void camera::clamp() {
+    current.zoom = std::clamp(current.zoom, 1, MAX_CAMERA_ZOOM);
+    current.x = std::clamp(current.x, 0, PLAYFIELD_WIDTH - PLAYFIELD_WIDTH / current.zoom);
+    current.y = std::clamp(current.y, 0, PLAYFIELD_HEIGHT - PLAYFIELD_HEIGHT / current.zoom);
+}
+const camera_view &camera::view() const { return current; }
+bool camera::is_zoomed() const { return current.zoom > 1; }
+void camera::zoom_at(int screen_x, int screen_y, int steps) {
+    // zooming needs the sprites
+    if (balls[MAX_CAMERA_ZOOM] == NULL) { return; }
+    const int x = board_x(screen_x) - GRID_X_OFFSET;
+    const int y = board_y(screen_y) - GRID_Y_OFFSET;
+    current.zoom = std::clamp(current.zoom + steps, 1, MAX_CAMERA_ZOOM);
+    current.x = x - (std::clamp(screen_x, GRID_X_OFFSET, GRID_X_OFFSET + PLAYFIELD_WIDTH) - GRID_X_OFFSET) / current.zoom;
+    current.y = y - (std::clamp(screen_y, GRID_Y_OFFSET, GRID_Y_OFFSET + PLAYFIELD_HEIGHT) - GRID_Y_OFFSET) / current.zoom;
+    clamp();
+}
+void camera::reset() {
+    current = camera_view{};
+    dragging = false;
+}
+void camera::handle(const SDL_Event &e) {
+    if (e.type == SDL_MOUSEBUTTONDOWN) {
+        if (e.button.button == SDL_BUTTON_WHEELUP) { zoom_at(e.button.x, e.button.y, 1); }
+        else if (e.button.button == SDL_BUTTON_WHEELDOWN) { zoom_at(e.button.x, e.button.y, -1); }
+        else if (e.button.button == SDL_BUTTON_MIDDLE) {
+            dragging = true;
+            anchor_x = board_x(e.button.x);
+            anchor_y = board_y(e.button.y);
+        }
+    } else if (e.type == SDL_MOUSEBUTTONUP && e.button.button == SDL_BUTTON_MIDDLE) {
+        dragging = false;
+    } else if (e.type == SDL_MOUSEMOTION && dragging) {
+        // keep the anchor under the cursor
+        current.x = anchor_x - GRID_X_OFFSET - (e.motion.x - GRID_X_OFFSET) / current.zoom;
+        current.y = anchor_y - GRID_Y_OFFSET - (e.motion.y - GRID_Y_OFFSET) / current.zoom;
+        clamp();
+    } else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_HOME) {
+        reset();
+    }
+}
+int camera::board_x(int screen_x) const {
+    const int offset = std::clamp(screen_x - GRID_X_OFFSET, 0, PLAYFIELD_WIDTH - 1);
+    return GRID_X_OFFSET + current.x + offset / current.zoom;
+}
+int camera::board_y(int screen_y) const {
+    const int offset = std::clamp(screen_y - GRID_Y_OFFSET, 0, PLAYFIELD_HEIGHT - 1);
+    return GRID_Y_OFFSET + current.y + offset / current.zoom;
+}
+SDL_Surface* camera::ball_sprite(int zoom) const { return (zoom > 1) ? balls[zoom] : balls_surface; }
+SDL_Surface* camera::wall_sprite(int zoom, bool colour) const {
+    if (zoom == 1) { return colour ? wall_black : wall_white; }
+    return colour ? walls_black[zoom] : walls_white[zoom];
+}
+SDL_Surface* camera::cell_sprite(int zoom) const { return open_cells[zoom]; }
+
+void camera_handle(SDL_Event &e) {
+    // zoom and scroll, then map clicks on the playfield to where they land on the board
+    screen_camera.handle(e);
+    if (!screen_camera.is_zoomed()) { return; }
+    if (e.type == SDL_MOUSEBUTTONDOWN || e.type == SDL_MOUSEBUTTONUP) {
+        const bool on_playfield = (e.button.x >= GRID_X_OFFSET) && (e.button.x < GRID_X_OFFSET + PLAYFIELD_WIDTH) && (e.button.y >= GRID_Y_OFFSET) && (e.button.y < GRID_Y_OFFSET + PLAYFIELD_HEIGHT);
+        if (on_playfield) {
+            e.button.x = screen_camera.board_x(e.button.x);
+            e.button.y = screen_camera.board_y(e.button.y);
+        }
+    }
+}
@@ -0,0 +1,263 @@
+#pragma once
+#include "SDL/SDL.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdio>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// CONTROL PROTOCOL
+// one command per line, every command is answered with one line starting with "ok" or "error"
+//     place <column> <row> <vertical|horizontal>    ok placed | ok blocked
+//     step <ticks>                                  ok <ticks stepped>, stops early when the level ends
+//     state                                         ok frame <f> level <l> lives <n> percentage <p> balls <b> walls <w> status <playing|complete|won|lost>
+//     snapshot                                      ok <columns> <rows> <cells> <balls> [<x> <y> <x_speed> <y_speed>]...
+//     next                                          ok <level>, starts the next level after one is complete
+//     quit                                          ok
+// cells are row by row, '.' open, '#' built, 'b' and 'w' waiting to be built black and white
+// commands can be sent ahead without waiting for answers, a single step runs any number of ticks
+const char* CONTROL_STDIO = "-";
+
+// bytes read at a time
+const std::size_t CONTROL_READ_SIZE = 4096;
+
+enum class control_status : unsigned char {
+    playing,
+    complete,
+    won,
+    lost,
+};
+
+const char* control_status_names[] = {"playing", "complete", "won", "lost"};
+
+class control_channel {
+    // line reader and writer over a pair of file descriptors, stdin and stdout or a unix socket
+    private:
+        int in_fd, out_fd;
+        int listen_fd;
+        std::string path;
+
+        // bytes read but not yet split into lines
+        std::string pending;
+
+    public:
+        control_channel();
+        ~control_channel();
+
+        // read from stdin and write to stdout, or wait for one client on a unix socket at path
+        bool open(const std::string &where);
+        void close();
+
+        // next line without its newline, false once the other end is closed
+        bool read_line(std::string &line);
+
+        // false once the other end is closed, which never raises SIGPIPE
+        bool write_line(const std::string &line);
+};
+
+// CONTROL CHANNEL CLASS
+control_channel::control_channel() {
+    in_fd = -1;
+    out_fd = -1;
+    listen_fd = -1;
+}
+control_channel::~control_channel() { close(); }
+bool control_channel::open(const std::string &where) {
+    if (where == CONTROL_STDIO) {
+        // a reader closing stdout fails the write with EPIPE instead of killing the game before its reports
+        std::signal(SIGPIPE, SIG_IGN);
+        in_fd = STDIN_FILENO;
+        out_fd = STDOUT_FILENO;
+        return true;
+    }
+
+    sockaddr_un address{};
+    if (where.size() >= sizeof(address.sun_path)) { return false; }
+    address.sun_family = AF_UNIX;
+    where.copy(address.sun_path, where.size());
+
+    listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd == -1) { return false; }
+    ::unlink(where.c_str());
+    if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1 || ::listen(listen_fd, 1) == -1) {
+        close();
+        return false;
+    }
+    path = where;
+
+    // serve one client
+    in_fd = ::accept(listen_fd, NULL, NULL);
+    out_fd = in_fd;
+    return in_fd != -1;
+}
+void control_channel::close() {
+    if (listen_fd != -1) {
+        if (in_fd != -1) { ::close(in_fd); }
+        ::close(listen_fd);
+        ::unlink(path.c_str());
+    }
+    in_fd = out_fd = listen_fd = -1;
+}
+bool control_channel::read_line(std::string &line) {
+    char buffer[CONTROL_READ_SIZE];
+    std::size_t newline;
+    while ((newline = pending.find('\n')) == std::string::npos) {
+        const ssize_t bytes = ::read(in_fd, buffer, sizeof(buffer));
+        if (bytes < 0 && errno == EINTR) { continue; }
+        if (bytes <= 0) {
+            // last line without a newline
+            if (pending.empty()) { return false; }
+            line.swap(pending);
+            pending.clear();
+            return true;
+        }
+        pending.append(buffer, bytes);
+    }
+    line.assign(pending, 0, newline);
+    if (!line.empty() && line.back() == '\r') { line.pop_back(); }
+    pending.erase(0, newline + 1);
+    return true;
+}
+bool control_channel::write_line(const std::string &line) {
+    std::string out = line + '\n';
+    std::size_t written = 0;
+    while (written < out.size()) {
+        // sockets are sent to without SIGPIPE, so a client disconnecting reads as the channel closing
+        const ssize_t bytes = (listen_fd != -1) ? ::send(out_fd, out.data() + written, out.size() - written, MSG_NOSIGNAL) : ::write(out_fd, out.data() + written, out.size() - written);
+        if (bytes < 0 && errno == EINTR) { continue; }
+        if (bytes <= 0) { return false; }
+        written += bytes;
+    }
+    return true;
+}
+
+control_status control_status_of(const options &parameters, const simulation &sim) {
+    if (sim.game_state.current_lives <= 0) { return control_status::lost; }
+    if (sim.game_state.current_percentage > parameters.PERCENTAGE_TARGET) {
+        return (sim.game_state.current_level + 1 > MAX_LEVEL) ? control_status::won : control_status::complete;
+    }
+    return control_status::playing;
+}
+
+void start_level(const options &parameters, simulation &sim, unsigned int level) {
+    // empty the board and spawn the level's balls
+    sim.game_state.current_level = level;
+    sim.game_state.current_percentage = 0;
+    sim.game_state.current_lives = parameters.STARTING_LIVES;
+    sim.walls_list.clear();
+    sim.walls_to_build_black.clear();
+    sim.walls_to_build_white.clear();
+    sim.walls_black_buffer.clear();
+    sim.walls_white_buffer.clear();
+    sim.walls_black_building = false;
+    sim.walls_white_building = false;
+    for (std::vector<button> &row : sim.grid) {
+        for (button &cell : row) {
+            cell.reset();
+        }
+    }
+    sim.balls_list.clear();
+    ball_init(parameters, sim.game_state, sim.balls_list);
+    sim.ball_timer.start();
+}
+
+void start_next_level(const options &parameters, simulation &sim) {
+    // what the game does when the level complete overlay is dismissed
+    start_level(parameters, sim, sim.game_state.current_level + 1);
+}
+
+std::string control_snapshot(const simulation &sim) {
+    const std::size_t cols = sim.grid.size();
+    const std::size_t rows = sim.grid[0].size();
+    std::string out = "ok " + std::to_string(cols) + " " + std::to_string(rows) + " ";
+    for (std::size_t row = 0; row < rows; ++row) {
+        for (std::size_t col = 0; col < cols; ++col) {
+            const button &cell = sim.grid[col][row];
+            out += cell.built ? '#' : (cell.active ? (cell.colour ? 'b' : 'w') : '.');
+        }
+    }
+    out += " " + std::to_string(sim.balls_list.size());
+    char number[64];
+    for (const ball &b : sim.balls_list) {
+        std::snprintf(number, sizeof(number), " %.3f %.3f %.3f %.3f", b.x_pos, b.y_pos, b.x_speed, b.y_speed);
+        out += number;
+    }
+    return out;
+}
+
+std::string control_command(const options &parameters, simulation &sim, std::string_view line) {
+    // run one command and return its answer
+    std::string_view command;
+    if (!next_token(line, command)) { return "error empty command"; }
+    std::string_view extra;
+
+    // PLACE
+    if (command == "place") {
+        int col, row;
+        std::string_view direction;
+        if (!next_number(line, col) || !next_number(line, row) || !next_token(line, direction) || (direction != "vertical" && direction != "horizontal") || next_token(line, extra)) {
+            return "error usage: place <column> <row> <vertical|horizontal>";
+        }
+        if (control_status_of(parameters, sim) != control_status::playing) { return "ok blocked"; }
+        return place_wall(sim, col, row, (direction == "vertical") ? orientation::vertical : orientation::horizontal) ? "ok placed" : "ok blocked";
+
+    // STEP
+    } else if (command == "step") {
+        unsigned long ticks;
+        if (!next_number(line, ticks) || next_token(line, extra)) { return "error usage: step <ticks>"; }
+        unsigned long stepped = 0;
+        while (stepped < ticks && !sim.game_state.quit && control_status_of(parameters, sim) == control_status::playing) {
+            tick_simulation(parameters, sim);
+            frame_handle(parameters, sim.game_state);
+            ++stepped;
+        }
+        return "ok " + std::to_string(stepped);
+
+    // STATE
+    } else if (command == "state") {
+        if (next_token(line, extra)) { return "error usage: state"; }
+        char out[256];
+        std::snprintf(out, sizeof(out), "ok frame %lu level %u lives %u percentage %.2f balls %zu walls %zu status %s", sim.game_state.frame, sim.game_state.current_level, sim.game_state.current_lives, sim.game_state.current_percentage, sim.balls_list.size(), sim.walls_list.size(), control_status_names[static_cast<int>(control_status_of(parameters, sim))]);
+        return out;
+
+    // SNAPSHOT
+    } else if (command == "snapshot") {
+        if (next_token(line, extra)) { return "error usage: snapshot"; }
+        return control_snapshot(sim);
+
+    // NEXT LEVEL
+    } else if (command == "next") {
+        if (next_token(line, extra)) { return "error usage: next"; }
+        if (control_status_of(parameters, sim) != control_status::complete) { return "error level not complete"; }
+        start_next_level(parameters, sim);
+        return "ok " + std::to_string(sim.game_state.current_level);
+
+    // QUIT
+    } else if (command == "quit") {
+        sim.game_state.quit = true;
+        return "ok";
+    }
+
+    return "error unknown command " + std::string(command);
+}
+
+bool control_session(const options &parameters, simulation &sim) {
+    // answer commands until quit or the other end closes, ticks are stepped on the virtual clock
+    control_channel channel;
+    if (!channel.open(parameters.CONTROL)) { return false; }
+
+    clock_fixed = true;
+    clock_step(sim.game_state.frame);
+    sim.ball_timer.start();
+
+    std::string line;
+    while (!sim.game_state.quit && channel.read_line(line)) {
+        if (line.find_first_not_of(" \t") == std::string::npos) { continue; }
+        if (!channel.write_line(control_command(parameters, sim, line))) { break; }
+    }
+    return true;
+}
@@ -0,0 +1,221 @@
+#pragma once
+#include "SDL/SDL.h"
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cctype>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// frames that may be waiting for the encoder before the simulation has to wait
+const int EXPORT_QUEUE_SIZE = 8;
+
+class frame_encoder {
+    // copies composited frames into a fixed pool of buffers and writes them out on a background thread
+    private:
+        std::string path;
+
+        // write one ppm file per frame instead of a single raw rgb24 stream
+        bool sequence;
+        std::FILE* stream;
+
+        // sequence file names are the prefix, the frame index zero padded to digits, and the suffix
+        std::string sequence_prefix;
+        std::string sequence_suffix;
+        int sequence_digits;
+
+        int width;
+        int height;
+
+        // buffer pool, indices move from free to queued and back once written
+        std::vector<std::vector<unsigned char>> buffers;
+        std::vector<int> free_buffers;
+        int queue[EXPORT_QUEUE_SIZE];
+        int queue_head;
+        int queue_count;
+
+        bool running;
+        bool failed;
+        unsigned long frames_written;
+        unsigned long stalls;
+
+        std::mutex queue_mutex;
+        std::condition_variable queue_changed;
+        std::thread encoder_worker;
+
+        // encoder thread body
+        void encode_loop();
+
+        // write one rgb24 frame
+        bool write_frame(const std::vector<unsigned char> &pixels, unsigned long index);
+
+    public:
+        frame_encoder();
+
+        // open output and launch encoder thread, returns false if the output cannot be opened or a sequence pattern is not a single %d or %0Nd
+        bool start(const std::string &filename, int w, int h);
+
+        // drain queued frames and join encoder thread
+        void stop();
+
+        // copy surface into a free buffer and queue it, waiting only if every buffer is queued
+        bool push(SDL_Surface* surface);
+
+        bool is_running() const;
+        unsigned long written() const;
+        unsigned long stalled() const;
+};
+
+void copy_pixels_rgb24(SDL_Surface* surface, std::vector<unsigned char> &pixels) {
+    // convert any surface format to packed rgb24
+    if (SDL_MUSTLOCK(surface)) { SDL_LockSurface(surface); }
+    const SDL_PixelFormat* format = surface->format;
+    unsigned char* out = pixels.data();
+    for (int y = 0; y < surface->h; ++y) {
+        const Uint8* row = static_cast<const Uint8*>(surface->pixels) + y*surface->pitch;
+        for (int x = 0; x < surface->w; ++x) {
+            Uint32 pixel;
+            switch (format->BytesPerPixel) {
+                case 1: pixel = row[x]; break;
+                case 2: pixel = reinterpret_cast<const Uint16*>(row)[x]; break;
+                case 4: pixel = reinterpret_cast<const Uint32*>(row)[x]; break;
+                default: pixel = row[3*x] | (row[3*x + 1] << 8) | (row[3*x + 2] << 16); break;
+            }
+            SDL_GetRGB(pixel, const_cast<SDL_PixelFormat*>(format), out, out + 1, out + 2);
+            out += 3;
+        }
+    }
+    if (SDL_MUSTLOCK(surface)) { SDL_UnlockSurface(surface); }
+}
+
+// FRAME ENCODER CLASS
+frame_encoder::frame_encoder() {
+    sequence = false;
+    stream = NULL;
+    sequence_digits = 0;
+    width = 0;
+    height = 0;
+    queue_head = 0;
+    queue_count = 0;
+    running = false;
+    failed = false;
+    frames_written = 0;
+    stalls = 0;
+}
+bool frame_encoder::start(const std::string &filename, int w, int h) {
+    path = filename;
+    width = w;
+    height = h;
+
+    // a printf style pattern selects an image sequence, split around its one conversion so the path is never used as a format
+    const std::size_t percent = path.find('%');
+    sequence = (percent != std::string::npos);
+    if (sequence) {
+        std::size_t end = percent + 1;
+        if (end < path.size() && path[end] == '0') {
+            while (end < path.size() && std::isdigit(static_cast<unsigned char>(path[end]))) { ++end; }
+        }
+        if (end >= path.size() || path[end] != 'd' || end - percent > 3 || path.find('%', end) != std::string::npos) { return false; }
+        sequence_digits = (end > percent + 1) ? std::stoi(path.substr(percent + 1, end - percent - 1)) : 0;
+        sequence_prefix = path.substr(0, percent);
+        sequence_suffix = path.substr(end + 1);
+    } else {
+        stream = std::fopen(path.c_str(), "wb");
+        if (stream == NULL) { return false; }
+    }
+
+    // allocate every buffer up front
+    buffers.assign(EXPORT_QUEUE_SIZE, std::vector<unsigned char>(3*width*height));
+    free_buffers.clear();
+    for (int n = 0; n < EXPORT_QUEUE_SIZE; ++n) { free_buffers.emplace_back(n); }
+
+    running = true;
+    encoder_worker = std::thread(&frame_encoder::encode_loop, this);
+    return true;
+}
+void frame_encoder::stop() {
+    if (!running) { return; }
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        running = false;
+    }
+    queue_changed.notify_all();
+    encoder_worker.join();
+    if (stream != NULL) {
+        std::fclose(stream);
+        stream = NULL;
+    }
+}
+bool frame_encoder::push(SDL_Surface* surface) {
+    int index;
+    {
+        // take a free buffer
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        if (free_buffers.empty()) {
+            ++stalls;
+            queue_changed.wait(lock, [this]{ return !free_buffers.empty() || failed; });
+        }
+        if (failed) { return false; }
+        index = free_buffers.back();
+        free_buffers.pop_back();
+    }
+
+    // convert without holding the lock
+    copy_pixels_rgb24(surface, buffers[index]);
+
+    {
+        // queue it
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        queue[(queue_head + queue_count) % EXPORT_QUEUE_SIZE] = index;
+        ++queue_count;
+    }
+    queue_changed.notify_all();
+    return true;
+}
+void frame_encoder::encode_loop() {
+    while (true) {
+        int index;
+        {
+            // wait for a queued frame, keep draining after stop
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_changed.wait(lock, [this]{ return queue_count > 0 || !running; });
+            if (queue_count == 0) { return; }
+            index = queue[queue_head];
+            queue_head = (queue_head + 1) % EXPORT_QUEUE_SIZE;
+            --queue_count;
+        }
+
+        // write without holding the lock
+        bool written = write_frame(buffers[index], frames_written);
+
+        {
+            // return buffer to the pool
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            free_buffers.emplace_back(index);
+            if (written) { ++frames_written; }
+            else { failed = true; }
+        }
+        queue_changed.notify_all();
+        if (!written) { return; }
+    }
+}
+bool frame_encoder::write_frame(const std::vector<unsigned char> &pixels, unsigned long index) {
+    // append to raw stream
+    if (!sequence) {
+        return std::fwrite(pixels.data(), 1, pixels.size(), stream) == pixels.size();
+    }
+
+    // write numbered ppm file
+    std::string number = std::to_string(index);
+    if (int(number.size()) < sequence_digits) { number.insert(0, sequence_digits - number.size(), '0'); }
+    const std::string filename = sequence_prefix + number + sequence_suffix;
+    std::FILE* image = std::fopen(filename.c_str(), "wb");
+    if (image == NULL) { return false; }
+    std::fprintf(image, "P6\n%d %d\n255\n", width, height);
+    bool written = std::fwrite(pixels.data(), 1, pixels.size(), image) == pixels.size();
+    return (std::fclose(image) == 0) && written;
+}
+bool frame_encoder::is_running() const { return running; }
+unsigned long frame_encoder::written() const { return frames_written; }
+unsigned long frame_encoder::stalled() const { return stalls; }
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <cmath>
+
+// FIXED POINT
+// 16.16 signed fixed point, integer arithmetic gives the same result on every compiler, flag set and build
+typedef std::int32_t fixed;
+
+// intermediate products and quotients
+typedef std::int64_t fixed_wide;
+
+const int FIXED_SHIFT = 16;
+const fixed FIXED_ONE = 1 << FIXED_SHIFT;
+
+// balls move in fixed point instead of float while set
+bool physics_fixed = false;
+
+// seed of the trajectory hash, fnv-1a offset basis
+const std::uint64_t TRAJECTORY_HASH_SEED = 14695981039346656037ull;
+
+constexpr fixed to_fixed(int value) { return value * FIXED_ONE; }
+
+fixed float_to_fixed(float value) { return static_cast<fixed>(std::lround(value * FIXED_ONE)); }
+
+float fixed_to_float(fixed value) { return static_cast<float>(value) / FIXED_ONE; }
+
+// whole pixels, rounding towards negative infinity
+constexpr int fixed_floor(fixed value) { return value >> FIXED_SHIFT; }
+
+constexpr fixed_wide fixed_mul(fixed_wide a, fixed_wide b) { return (a * b) >> FIXED_SHIFT; }
+
+constexpr fixed_wide fixed_div(fixed_wide a, fixed_wide b) { return (a * FIXED_ONE) / b; }
+
+std::uint64_t hash_fixed(std::uint64_t hash, fixed value) {
+    // fold one value into an fnv-1a hash, byte by byte so the result does not depend on endianness
+    const std::uint32_t bits = static_cast<std::uint32_t>(value);
+    for (int byte = 0; byte < 4; ++byte) {
+        hash ^= (bits >> (8*byte)) & 0xff;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
@@ -3,9 +3,11 @@
 #include <vector>
 #include <cstdlib>
 #include <utility>
-#include <sstream>
 #include <cmath>
+#include <cstdio>
 #include <algorithm>
+#include <thread>
+#include <iostream>
 
 // INITIALIZATION
 void arguments_init(int argc, char* argv[], options &parameters){
@@ -25,7 +27,27 @@ void button_init(std::vector<std::vector<button>> &grid) {
     }
 }
 
+void level_storage_init(const std::vector<std::vector<button>> &grid, std::vector<wall> &walls_list, std::vector<button> &walls_to_build_black, std::vector<button> &walls_to_build_white, std::vector<button> &walls_black_buffer, std::vector<button> &walls_white_buffer, std::vector<ball> &balls_list) {
+    // reserve the most a level can hold, so a level change only resets sizes and frames never reallocate
+    const std::size_t cells = grid.size() * grid[0].size();
+    const std::size_t segment = std::max(grid.size(), grid[0].size());
+
+    // every cell becomes a wall at most once per level
+    walls_list.reserve(cells);
+
+    // pending segments never exceed one row or column
+    walls_to_build_black.reserve(segment);
+    walls_to_build_white.reserve(segment);
+    walls_black_buffer.reserve(segment);
+    walls_white_buffer.reserve(segment);
+
+    // one ball per level
+    balls_list.reserve(MAX_LEVEL);
+}
+
 void ball_init(const options &parameters, const state &game_state, std::vector<ball> &balls_list) {
+    trace_zone zone("ball_init");
+
     // construct n balls, where n = value of current level
     for (unsigned int n = 0; n < game_state.current_level; ++n) {
         // generate ball in random location in playfield that while not overlapping with another ball
@@ -48,30 +70,89 @@ void ball_init(const options &parameters, const state &game_state, std::vector<b
     }
 }
 
-// EVENT HANDLING
-void pause_handle(timer &fps, timer &ball_timer, std::vector<button> &walls_to_build_black, std::vector<button> &walls_to_build_white) {
-    if (((event.type == SDL_KEYDOWN) && (event.key.keysym.sym == SDLK_ESCAPE)) || ((event.type == SDL_ACTIVEEVENT) && (event.active.gain == 0))){
-        // pause if esc key is pressed or app loses focus
-        if (fps.is_paused() && (SDL_GetAppState() & SDL_APPMOUSEFOCUS)) {
-            // unpause timers
-            fps.unpause();
-            ball_timer.unpause();
-            // unpause wall delay timers
-            for (button &current_wall : walls_to_build_black ) { current_wall.delay_timer.unpause(); }
-            for (button &current_wall : walls_to_build_white ) { current_wall.delay_timer.unpause(); }
-        }
-        // unpause if esc key is pressed and app is in focus
-        else {
-            // display pause overlay
-            apply_surface((SCREEN_WIDTH-pause_surface->w)/2, (SCREEN_HEIGHT-pause_surface->h)/2, pause_surface, screen);
-            // pause timers
-            fps.pause();
-            ball_timer.pause();
-            // pause wall delay timers
-            for (button &current_wall : walls_to_build_black ) { current_wall.delay_timer.pause(); }
-            for (button &current_wall : walls_to_build_white ) { current_wall.delay_timer.pause(); }
+// LEVEL LOADING
+class level_loader {
+    // spawns the next level on a worker thread while the level complete overlay is shown
+    private:
+        // storage the next level is prepared in, swapped with the game's storage on resume
+        std::vector<std::vector<button>> next_grid;
+        std::vector<ball> next_balls;
+
+        const options* parameters;
+        state next_state;
+
+        bool loading;
+        std::thread loader_worker;
+
+        // worker body, reset cells and spawn balls
+        void load();
+
+    public:
+        level_loader();
+
+        // prepare the level in game_state in the background
+        void start(const options &parameters, const state &game_state);
+
+        // wait for the prepared level and swap it in, the previous level's storage is reused by the next load
+        void finish(std::vector<std::vector<button>> &grid, std::vector<ball> &balls_list);
+
+        // wait for the worker and discard its level
+        void stop();
+
+        bool is_loading() const;
+};
+
+// LEVEL LOADER CLASS
+level_loader::level_loader() {
+    parameters = NULL;
+    loading = false;
+}
+void level_loader::load() {
+    trace_zone zone("prepare_level");
+
+    // reset cells, or build them the first time
+    if (next_grid.empty()) { button_init(next_grid); }
+    for (std::vector<button> &row : next_grid) {
+        for (button &cell : row) {
+            cell.reset();
         }
     }
+
+    // spawn balls
+    next_balls.clear();
+    next_balls.reserve(MAX_LEVEL);
+    ball_init(*parameters, next_state, next_balls);
+}
+void level_loader::start(const options &parameters, const state &game_state) {
+    stop();
+    this->parameters = &parameters;
+    next_state = game_state;
+    loading = true;
+    loader_worker = std::thread(&level_loader::load, this);
+}
+void level_loader::finish(std::vector<std::vector<button>> &grid, std::vector<ball> &balls_list) {
+    if (!loading) { return; }
+    loader_worker.join();
+    loading = false;
+    grid.swap(next_grid);
+    balls_list.swap(next_balls);
+}
+void level_loader::stop() {
+    if (!loading) { return; }
+    loader_worker.join();
+    loading = false;
+}
+bool level_loader::is_loading() const { return loading; }
+
+// EVENT HANDLING
+bool pause_event() {
+    // esc key is pressed or app loses focus
+    return ((event.type == SDL_KEYDOWN) && (event.key.keysym.sym == SDLK_ESCAPE)) || ((event.type == SDL_ACTIVEEVENT) && (event.active.gain == 0));
+}
+
+bool resume_event() {
+    // esc key is pressed while the app is in focus
+    return pause_event() && (SDL_GetAppState() & SDL_APPMOUSEFOCUS);
 }
 
 void orientation_handle(orientation &wall_orientation) {
@@ -83,52 +164,68 @@ void orientation_handle(orientation &wall_orientation) {
     }
 }
 
+void stats_handle(state &game_state) {
+    // toggle engine stats overlay with F3
+    if ((event.type == SDL_KEYDOWN) && (event.key.keysym.sym == SDLK_F3)) {
+        game_state.show_stats = !game_state.show_stats;
+    }
+}
+
 // RENDERING
-void render_digits(unsigned int number, int digit_1_offset, int digit_2_offset, bool invert) {
-    // split number 0-99 into two digits
-    if (number > 99) { return; }
-    const int digit_1 = number / 10;
-    const int digit_2 = number % 10;
-
-    if (digit_1 == 0) {
-        if (!invert) {
-            // digit 1 = digit 2
-            apply_surface(digit_1_offset, 0, digits_surface, screen, &digits_clip[digit_2]);
-        } else {
-            apply_surface(digit_2_offset, 0, digits_surface, screen, &digits_clip[digit_2]);
-        }
-    } else {
-        apply_surface(digit_1_offset, 0, digits_surface, screen, &digits_clip[digit_1]);
-        apply_surface(digit_2_offset, 0, digits_surface, screen, &digits_clip[digit_2]);
+void cap_handle(const options &parameters, const timer &frame_timer) {
+    // sleep out the rest of the frame, headless runs go as fast as they can
+    if (!parameters.HEADLESS && frame_timer.get_ticks() < 1000 / FPS_CAP) {
+        trace_zone zone("SDL_Delay");
+        SDL_Delay((1000/FPS_CAP) - frame_timer.get_ticks());
     }
 }
 
-void hud_handle(const state &game_state) {
-    // render level, lives, captured percentage
-    render_digits(game_state.current_level, LEVEL_DIGIT_1_OFFSET, LEVEL_DIGIT_2_OFFSET, false);
-    render_digits(game_state.current_lives, LIVES_DIGIT_1_OFFSET, LIVES_DIGIT_2_OFFSET, false);
-    render_digits(game_state.current_percentage, PERCENTAGE_DIGIT_1_OFFSET, PERCENTAGE_DIGIT_2_OFFSET, true);
+void fps_handle(const options &parameters, const timer &frame_timer, unsigned int start_time, bool idle) {
+    // display fps, put off on frames without time to spare
+    if (scheduler.admit(TASK_CAPTION)) {
+        // frame lasts at least until the cap below
+        unsigned int frame_time = SDL_GetTicks() - start_time;
+        if (!parameters.HEADLESS) { frame_time = std::max(frame_time, 1000u / FPS_CAP); }
+        float fps_calculated = (frame_time > 0) ? 1000.0f / frame_time : 0.0f;
+        char caption[32];
+        std::snprintf(caption, sizeof(caption), "JezzBall - FPS: %.0f", std::round(fps_calculated));
+        SDL_WM_SetCaption(caption, NULL);
+        scheduler.done(TASK_CAPTION);
+    }
+    scheduler.end_frame();
+
+    // nothing moves while idle, so sleep until an event arrives, otherwise cap fps
+    if (idle) {
+        trace_zone zone("wait_events");
+        SDL_WaitEvent(NULL);
+    } else { cap_handle(parameters, frame_timer); }
 }
 
-void fps_handle(timer &fps, unsigned int start_time) {
-    // cap fps
-    if (fps.get_ticks() < 1000 / FPS_CAP) { SDL_Delay((1000/FPS_CAP) - fps.get_ticks()); }
-    unsigned int frame_time = SDL_GetTicks() - start_time;
-    float fps_calculated = (frame_time > 0) ? 1000.0f / frame_time : 0.0f;
-    // display fps
-    std::stringstream caption;
-    caption << "JezzBall - FPS: " << std::round(fps_calculated);
-    SDL_WM_SetCaption(caption.str().c_str(), NULL);
+void frame_handle(const options &parameters, state &game_state) {
+    // close frame counters
+    stats.end_frame();
+
+    // advance virtual clock by one frame
+    ++game_state.frame;
+    if (clock_fixed) { clock_step(game_state.frame); }
+
+    // stop after frame limit
+    if ((parameters.FRAME_LIMIT > 0) && (game_state.frame >= parameters.FRAME_LIMIT)) { game_state.quit = true; }
 }
 
 // GAME LOGIC
-void handle_ball_collisions(ball &current_ball, std::vector<ball> &balls_list, timer &ball_timer) {
-    // detect ball collisions
-    for (ball &other_ball : balls_list) {
+void handle_ball_collisions(ball &current_ball, std::vector<ball> &balls_list, std::span<const std::size_t> others, std::span<const wall> walls, int dt_ms) {
+    trace_zone zone("handle_ball_collisions");
+
+    // detect ball collisions with the balls that can reach it
+    for (std::size_t other : others) {
+        ball &other_ball = balls_list[other];
         if (&current_ball != &other_ball) {
             if (check_collision(current_ball.hitbox, other_ball.hitbox)) {
+                // fixed point response
+                if (physics_fixed) { current_ball.bounce_fixed(other_ball); }
                 // if x-directions are different
-                if ((current_ball.x_speed > 0 && other_ball.x_speed < 0) || (current_ball.x_speed < 0 && other_ball.x_speed > 0)) {
+                else if ((current_ball.x_speed > 0 && other_ball.x_speed < 0) || (current_ball.x_speed < 0 && other_ball.x_speed > 0)) {
                     current_ball.x_speed *= -1;
                     other_ball.x_speed *= -1;
                     current_ball.set_direction(current_ball.x_pos, other_ball.x_pos);
@@ -148,23 +245,25 @@ void handle_ball_collisions(ball &current_ball, std::vector<ball> &balls_list, t
                     current_ball.set_direction(current_ball.x_pos, other_ball.x_pos);
                     current_ball.set_direction(current_ball.y_pos, other_ball.y_pos);
                 }
-                other_ball.update(ball_timer);
+                other_ball.update(dt_ms, walls);
             }
         }
     }
 }
 
-void handle_wall_collisions(state &game_state, ball &current_ball, std::vector<wall> &walls_list, std::vector<button> &walls_to_build_black, std::vector<button> &walls_to_build_white, std::vector<button> &walls_black_buffer, std::vector<button> &walls_white_buffer) {            
-
-    //  check for collision with a wall in buffers
-    if (check_collision(current_ball.hitbox, walls_black_buffer)) {
+void handle_building_collisions(state &game_state, ball &current_ball, std::vector<button> &walls_to_build_black, std::vector<button> &walls_to_build_white, std::vector<button> &walls_black_buffer, std::vector<button> &walls_white_buffer) {
+    //  check for collision with a wall in buffers, overlapping or touched while moving
+    bool hit_black = check_collision(current_ball.hitbox, walls_black_buffer) || check_contact(current_ball, walls_black_buffer);
+    bool hit_white = check_collision(current_ball.hitbox, walls_white_buffer) || check_contact(current_ball, walls_white_buffer);
+    current_ball.contact_count = 0;
+    if (hit_black) {
         // subtract life, ensure only one live removed per wall and lives do not go below 0
         if (!walls_to_build_black.empty() || !walls_black_buffer.empty()) {
             game_state.current_lives = game_state.current_lives > 0 ? game_state.current_lives - 1 : 0;
             walls_to_build_black.clear();
             walls_black_buffer.clear();
         }
-    } else if (check_collision(current_ball.hitbox, walls_white_buffer)) {
+    } else if (hit_white) {
         // subtract life, ensure only one live removed per wall and lives do not go below 0
         if (!walls_to_build_white.empty() || !walls_white_buffer.empty()) {
             game_state.current_lives = game_state.current_lives > 0 ? game_state.current_lives - 1 : 0;
@@ -172,12 +271,25 @@ void handle_wall_collisions(state &game_state, ball &current_ball, std::vector<w
             walls_white_buffer.clear();
         }
     }
+}
+
+void handle_wall_collisions(state &game_state, ball &current_ball, std::span<const wall> walls, std::vector<button> &walls_to_build_black, std::vector<button> &walls_to_build_white, std::vector<button> &walls_black_buffer, std::vector<button> &walls_white_buffer) {            
+    trace_zone zone("handle_wall_collisions");
+
+    // walls being built cost a life
+    handle_building_collisions(game_state, current_ball, walls_to_build_black, walls_to_build_white, walls_black_buffer, walls_white_buffer);
 
     // check for collision with an active wall
-    if (wall w = check_collision(current_ball.hitbox, walls_list)) {
-        
-        float dx = (current_ball.x_pos + current_ball.rad)/2 - (w.hitbox.x + w.hitbox.w)/2;
-        float dy = (current_ball.y_pos + current_ball.rad)/2 - (w.hitbox.y + w.hitbox.h)/2;
+    if (const wall* w = check_collision(current_ball.hitbox, walls)) {
+
+        // fixed point response
+        if (physics_fixed) {
+            current_ball.push_out_fixed(w->hitbox);
+            return;
+        }
+
+        float dx = (current_ball.x_pos + current_ball.rad)/2 - (w->hitbox.x + w->hitbox.w)/2;
+        float dy = (current_ball.y_pos + current_ball.rad)/2 - (w->hitbox.y + w->hitbox.h)/2;
         float offset = current_ball.rad / 10.0;
 
         // if dx and dy are very close, assume equal collision 
@@ -192,32 +304,32 @@ void handle_wall_collisions(state &game_state, ball &current_ball, std::vector<w
         if (std::abs(dx) > std::abs(dy)) {
             // wall <- ball
             if (dx >= 0) {
-                // std::cout << "wall <- ball " << current_ball.x_pos << " " << w.hitbox.x << std::endl;
+                // std::cout << "wall <- ball " << current_ball.x_pos << " " << w->hitbox.x << std::endl;
                 current_ball.x_speed *= -1;
-                current_ball.x_pos = std::clamp(current_ball.x_pos, float(w.hitbox.x + w.hitbox.w), float(SCREEN_WIDTH - GRID_X_OFFSET - current_ball.rad));
+                current_ball.x_pos = std::clamp(current_ball.x_pos, float(w->hitbox.x + w->hitbox.w), float(SCREEN_WIDTH - GRID_X_OFFSET - current_ball.rad));
                 current_ball.x_pos += offset;
             }
             // ball -> wall
             else  {
-                // std::cout << "ball -> wall " << current_ball.x_pos << " " << w.hitbox.x << std::endl;
+                // std::cout << "ball -> wall " << current_ball.x_pos << " " << w->hitbox.x << std::endl;
                 current_ball.x_speed *= -1;
-                current_ball.x_pos = std::clamp(current_ball.x_pos, float(GRID_X_OFFSET), float(w.hitbox.x));
+                current_ball.x_pos = std::clamp(current_ball.x_pos, float(GRID_X_OFFSET), float(w->hitbox.x));
                 current_ball.x_pos -= offset;
             }
         // y-collision
         } else {
             // ball ^ wall
             if (dy >= 0) {
-                // std::cout << "ball ^ wall " << current_ball.y_pos << " " << w.hitbox.y << std::endl;
+                // std::cout << "ball ^ wall " << current_ball.y_pos << " " << w->hitbox.y << std::endl;
                 current_ball.y_speed *= -1;
-                current_ball.y_pos = std::clamp(current_ball.y_pos, float(w.hitbox.y + w.hitbox.h), float(SCREEN_HEIGHT - GRID_Y_OFFSET - current_ball.rad));
+                current_ball.y_pos = std::clamp(current_ball.y_pos, float(w->hitbox.y + w->hitbox.h), float(SCREEN_HEIGHT - GRID_Y_OFFSET - current_ball.rad));
                 current_ball.y_pos += offset;
             }
             // ball v wall
             else {
-                // std::cout << "ball v wall " << current_ball.y_pos << " " << w.hitbox.y << std::endl; 
+                // std::cout << "ball v wall " << current_ball.y_pos << " " << w->hitbox.y << std::endl; 
                 current_ball.y_speed *= -1;
-                current_ball.y_pos = std::clamp(current_ball.y_pos, float(GRID_Y_OFFSET), float(w.hitbox.y));
+                current_ball.y_pos = std::clamp(current_ball.y_pos, float(GRID_Y_OFFSET), float(w->hitbox.y));
                 current_ball.y_pos -= offset;
             }
         }
@@ -225,25 +337,58 @@ void handle_wall_collisions(state &game_state, ball &current_ball, std::vector<w
     }
 }
 
-void ball_handle(state &game_state, std::vector<ball> &balls_list, timer &ball_timer, std::vector<wall> &walls_list, std::vector<button> &walls_to_build_black, std::vector<button> &walls_to_build_white, std::vector<button> &walls_black_buffer, std::vector<button> &walls_white_buffer) {
-    // for each ball on screen
-    for (ball &current_ball : balls_list) {
-        // apply texture
-        apply_surface(current_ball.x_pos, current_ball.y_pos, balls_surface, screen);
- 
+void region_handle(state &game_state, std::vector<ball> &balls_list, std::span<const std::size_t> members, std::span<const wall> walls, std::vector<button> &walls_to_build_black, std::vector<button> &walls_to_build_white, std::vector<button> &walls_black_buffer, std::vector<button> &walls_white_buffer, int dt_ms) {
+    // move the balls of one region, against its walls and each other
+    for (std::size_t member : members) {
+        ball &current_ball = balls_list[member];
+
         // handle wall collisions
-        handle_wall_collisions(game_state, current_ball, walls_list, walls_to_build_black, walls_to_build_white, walls_black_buffer, walls_white_buffer);
-        current_ball.update(ball_timer);
+        handle_wall_collisions(game_state, current_ball, walls, walls_to_build_black, walls_to_build_white, walls_black_buffer, walls_white_buffer);
+        current_ball.update(dt_ms, walls);
 
         // handle ball collisions
-        handle_ball_collisions(current_ball, balls_list, ball_timer);
-        current_ball.update(ball_timer);
+        handle_ball_collisions(current_ball, balls_list, members, walls, dt_ms);
+        current_ball.update(dt_ms, walls);
+    }
+}
+
+void ball_handle(state &game_state, std::vector<ball> &balls_list, timer &ball_timer, std::vector<wall> &walls_list, std::vector<button> &walls_to_build_black, std::vector<button> &walls_to_build_white, std::vector<button> &walls_black_buffer, std::vector<button> &walls_white_buffer, region_map &regions, kinetic_engine &kinetic) {
+    trace_zone zone("ball_handle");
+
+    // time since last update in milliseconds
+    const int dt_ms = ball_timer.get_ticks();
+    game_state.tick_ms = dt_ms;
+
+    if (physics_kinetic) {
+        // only the collisions predicted within the tick are handled, walls being built are checked where balls end up and against what they touched
+        kinetic.tick(walls_list, balls_list, dt_ms);
+        for (ball &current_ball : balls_list) {
+            handle_building_collisions(game_state, current_ball, walls_to_build_black, walls_to_build_white, walls_black_buffer, walls_white_buffer);
+        }
+    } else if (regions.sync(walls_list, balls_list)) {
+        // balls in different sealed regions never meet, so each region is stepped on its own, in the same order within it
+        // a ball reaching across regions or into a wall has every ball step against every wall instead
+        for (int region = 0; region < regions.regions(); ++region) {
+            region_handle(game_state, balls_list, regions.balls_of(region), regions.walls_of(region), walls_to_build_black, walls_to_build_white, walls_black_buffer, walls_white_buffer, dt_ms);
+        }
+    } else {
+        region_handle(game_state, balls_list, regions.all_balls(), walls_list, walls_to_build_black, walls_to_build_white, walls_black_buffer, walls_white_buffer, dt_ms);
+    }
+
+    // fold fixed point state into the trajectory hash
+    if (physics_fixed) {
+        for (const ball &current_ball : balls_list) {
+            game_state.trajectory_hash = hash_fixed(game_state.trajectory_hash, current_ball.x_fixed);
+            game_state.trajectory_hash = hash_fixed(game_state.trajectory_hash, current_ball.y_fixed);
+            game_state.trajectory_hash = hash_fixed(game_state.trajectory_hash, current_ball.x_speed_fixed);
+            game_state.trajectory_hash = hash_fixed(game_state.trajectory_hash, current_ball.y_speed_fixed);
+        }
     }
     // restart ball timer
     ball_timer.start();
 }
 
-void button_handle(std::vector<std::vector<button>> &grid, std::vector<wall> &walls_list, std::vector<button> &walls_to_build_black, std::vector<button> &walls_to_build_white, orientation &wall_orientation) {
+void button_handle(std::vector<std::vector<button>> &grid, std::vector<wall> &walls_list, wall_occupancy &occupancy, std::vector<button> &walls_to_build_black, std::vector<button> &walls_to_build_white, orientation &wall_orientation, int now) {
     // mouse button pressed
     if (event.type == SDL_MOUSEBUTTONDOWN) {
         // left click
@@ -259,31 +404,24 @@ void button_handle(std::vector<std::vector<button>> &grid, std::vector<wall> &wa
                 
                 // if button is within gameplay area
                 if ((grid_x >= 0 && grid_x < grid.size()) && (grid_y >= 0 && grid_y < grid[0].size())) {
-                    grid[grid_x][grid_y].handle(grid, walls_list, walls_to_build_black, walls_to_build_white, wall_orientation);
+                    grid[grid_x][grid_y].handle(grid, walls_list, occupancy, walls_to_build_black, walls_to_build_white, wall_orientation, now);
                 }
             }
         }
     }
 }
 
-void wall_handle(std::vector<wall> &walls_list) {
-    // for each wall placed
-    for (wall &current_wall : walls_list) {
-        // render wall
-        if (current_wall.colour) {
-            SDL_BlitSurface(wall_black, NULL, screen, &current_wall.hitbox);
-        } else {
-            SDL_BlitSurface(wall_white, NULL, screen, &current_wall.hitbox);
-        }
-    }
-}
+void build_walls(const options &parameters, const timer &build_timer, std::vector<std::vector<button>> &grid, std::vector<wall> &walls_list, std::vector<button> &walls_to_build, std::vector<button> &walls_buffer, bool &walls_building) {
+    trace_zone zone("build_walls");
+
+    stats.add(PENDING_SEGMENTS, walls_to_build.size());
 
-void build_walls(const options &parameters, std::vector<std::vector<button>> &grid, std::vector<wall> &walls_list, std::vector<button> &walls_to_build, std::vector<button> &walls_buffer, bool &walls_building) {
     // for each wall in walls to build
+    const int now = build_timer.get_ticks();
     std::vector<button>::iterator current_wall = walls_to_build.begin();
     while (current_wall != walls_to_build.end()) {
         // if the wall is ready to be built
-        if ((current_wall->delay_timer.get_ticks() > (parameters.BUILD_SPEED*parameters.BUILD_SPEED_MODIFIER)*current_wall->delay_counter)) {
+        if ((now - current_wall->queued_at > (parameters.BUILD_SPEED*parameters.BUILD_SPEED_MODIFIER)*current_wall->delay_counter)) {
             // set cell in grid to built
             grid[current_wall->col()][current_wall->row()].built = true;
             // add wall to walls buffer
@@ -301,92 +439,92 @@ void build_walls(const options &parameters, std::vector<std::vector<button>> &gr
     if (walls_to_build.empty()) { walls_building = false; walls_buffer.clear(); }
 }
 
-bool check_fill(std::vector<std::vector<button>> &grid, int x, int y, int max_x, int max_y, std::vector<std::vector<bool>> &visited, std::vector<ball> &balls_list) { 
-    // does not fill if cell is out of bounds
-    if (x < 0 || x > max_x || y < 0 || y > max_y) { return false; }
-
-    // does not fill if contains ball
-    for (ball &current_ball : balls_list) {
-        float grid_x = ((current_ball.x_pos + current_ball.rad/2.0) - GRID_X_OFFSET) / GRID_DIM;
-        float grid_y = ((current_ball.y_pos + current_ball.rad/2.0) - GRID_Y_OFFSET) / GRID_DIM;
-        float grid_offset = GRID_DIM / current_ball.rad;
-        // if ball is within area
-        if ((x <= grid_x+grid_offset && x >= grid_x-grid_offset) && (y <= grid_y+grid_offset && y >= grid_y-grid_offset)) { return false; }
+int flood_component(const std::vector<std::vector<button>> &grid, fill_workspace &fill, int x, int y, int max_x, int max_y) {
+    // label the open cells connected to x, y and return the label
+    // the component fills unless it reaches the edge of the grid, or a ball is close to one of its cells or the walls around it
+    const int rows = max_y + 1;
+    const int label = fill.fillable.size();
+    bool fillable = true;
+    unsigned long visited = 0;
+
+    fill.stack.clear();
+    fill.stack.emplace_back(x*rows + y);
+    fill.component[x*rows + y] = label;
+    while (!fill.stack.empty()) {
+        const int cell = fill.stack.back();
+        fill.stack.pop_back();
+        ++visited;
+        if (fill.near_ball[cell]) { fillable = false; }
+
+        // check all directions
+        const int cell_x = cell / rows;
+        const int cell_y = cell % rows;
+        const int neighbours[4][2] = {{cell_x - 1, cell_y}, {cell_x + 1, cell_y}, {cell_x, cell_y - 1}, {cell_x, cell_y + 1}};
+        for (const int (&neighbour)[2] : neighbours) {
+            const int n_x = neighbour[0];
+            const int n_y = neighbour[1];
+            if (n_x < 0 || n_x > max_x || n_y < 0 || n_y > max_y) { fillable = false; continue; }
+            const int n = n_x*rows + n_y;
+            if (grid[n_x][n_y].built) {
+                if (fill.near_ball[n]) { fillable = false; }
+            } else if (fill.component[n] < 0) {
+                fill.component[n] = label;
+                fill.stack.emplace_back(n);
+            }
+        }
     }
 
-    // can fill if cell is built or already visited
-    if (grid[x][y].built || visited[x][y]) { return true;}
-
-    // set cell to visited
-    visited[x][y] = true;
+    stats.add(FILL_CELLS_VISITED, visited);
+    fill.fillable.emplace_back(fillable);
+    return label;
+}
 
-    // check all directions recursively
-    if (check_fill(grid, x-1, y, max_x, max_y, visited, balls_list) == false) { return false; };
-    if (check_fill(grid, x+1, y, max_x, max_y, visited, balls_list) == false) { return false; };
-    if (check_fill(grid, x, y-1, max_x, max_y, visited, balls_list) == false) { return false; };
-    if (check_fill(grid, x, y+1, max_x, max_y, visited, balls_list) == false) { return false; };
+void fill_handle(state &game_state, std::vector<std::vector<button>> &grid, std::vector<wall> &walls_list, bool walls_black_building, bool walls_white_building, std::vector<ball> &balls_list, fill_workspace &fill) {
+    trace_zone zone("check_fill");
 
-    // else
-    return true;
-}
+    const int max_x = grid.size() - 1;
+    const int max_y = grid[0].size() - 1;
+    const int rows = max_y + 1;
+    const std::size_t cells = grid.size() * grid[0].size();
+
+    // size storage once, later frames reuse it
+    if (fill.component.size() != cells) {
+        fill.component.assign(cells, -1);
+        fill.near_ball.assign(cells, 0);
+        fill.fillable.reserve(cells);
+        fill.stack.reserve(cells);
+    }
 
-void handle_endgame(bool win, SDL_Surface* condition_surface, SDL_Surface* condition_animation_surface, state &game_state, timer &fps, timer &quit_timer, std::vector<wall> &walls_list, std::vector<button> &walls_to_build_black, std::vector<button> &walls_to_build_white, std::vector<button> &walls_black_buffer, std::vector<button> &walls_white_buffer, std::vector<ball> &balls_list, timer &ball_timer) {
-    // get ready to quit the game
-    if (!quit_timer.is_started()) {
-        quit_timer.start();
-        fps.stop();
-        ball_timer.stop();
-    }
-    
-    while (quit_timer.is_started() && !game_state.quit) {
-        // render image to screen
-        SDL_FillRect(screen, NULL, 0x000000);
-        SDL_BlitSurface(background_surface, NULL, screen, NULL);
-        wall_handle(walls_list);
-        ball_handle(game_state, balls_list, ball_timer, walls_list, walls_to_build_black, walls_to_build_white, walls_black_buffer, walls_white_buffer);
-        
-        // animate screen
-        if (quit_timer.get_ticks() % 1500 < 750) {
-            apply_surface((SCREEN_WIDTH-condition_surface->w)/2, (SCREEN_HEIGHT-condition_surface->h)/2, condition_surface, screen);
-            hud_handle(game_state);
-        }
-        else {
-            apply_surface((SCREEN_WIDTH-condition_animation_surface->w)/2, (SCREEN_HEIGHT-condition_animation_surface->h)/2, condition_animation_surface, screen);
-            if (win) {
-                // flash level
-                render_digits(game_state.current_lives, LIVES_DIGIT_1_OFFSET, LIVES_DIGIT_2_OFFSET, false);
-                render_digits(game_state.current_percentage, PERCENTAGE_DIGIT_1_OFFSET, PERCENTAGE_DIGIT_2_OFFSET, true);
-            } else {
-                // flash lives
-                render_digits(game_state.current_level, LEVEL_DIGIT_1_OFFSET, LEVEL_DIGIT_2_OFFSET, false);
-                render_digits(game_state.current_percentage, PERCENTAGE_DIGIT_1_OFFSET, PERCENTAGE_DIGIT_2_OFFSET, true);
-            }
-        }
-        SDL_Flip(screen);
-        
-        // wait for quit or escape key to exit
-        while(SDL_PollEvent(&event)) {
-            if ((event.type == SDL_QUIT) || ((event.type == SDL_KEYDOWN) && (event.key.keysym.sym == SDLK_ESCAPE))) {
-                game_state.quit = true;
-                break;
+    // mark cells close enough to a ball that they do not fill
+    std::fill(fill.near_ball.begin(), fill.near_ball.end(), 0);
+    for (ball &current_ball : balls_list) {
+        float grid_x = ((current_ball.x_pos + current_ball.rad/2.0) - GRID_X_OFFSET) / GRID_DIM;
+        float grid_y = ((current_ball.y_pos + current_ball.rad/2.0) - GRID_Y_OFFSET) / GRID_DIM;
+        float grid_offset = GRID_DIM / current_ball.rad;
+        const int x_first = std::max(0, int(std::ceil(grid_x - grid_offset)));
+        const int x_last = std::min(max_x, int(std::floor(grid_x + grid_offset)));
+        const int y_first = std::max(0, int(std::ceil(grid_y - grid_offset)));
+        const int y_last = std::min(max_y, int(std::floor(grid_y + grid_offset)));
+        for (int x = x_first; x <= x_last; ++x) {
+            for (int y = y_first; y <= y_last; ++y) {
+                // if ball is within area
+                if ((x <= grid_x+grid_offset && x >= grid_x-grid_offset) && (y <= grid_y+grid_offset && y >= grid_y-grid_offset)) { fill.near_ball[x*rows + y] = 1; }
             }
         }
     }
-}
 
-void update_game_state(const options &parameters, state &game_state, timer &fps, timer &level_timer, timer &quit_timer, std::vector<std::vector<button>> &grid, std::vector<wall> &walls_list, std::vector<button> &walls_to_build_black, std::vector<button> &walls_to_build_white, std::vector<button> &walls_black_buffer, std::vector<button> &walls_white_buffer, bool &walls_black_building, bool &walls_white_building, std::vector<ball> &balls_list, timer &ball_timer) {
+    // label each component of open cells once, the first time the scan reaches it
+    std::fill(fill.component.begin(), fill.component.end(), -1);
+    fill.fillable.clear();
 
     // for each cell in grid, check if walls need to be filled
-    const int max_x = grid.size() - 1;
-    const int max_y = grid[0].size() - 1;
-    std::vector<std::vector<bool>> visited(max_x + 1, std::vector<bool>(max_y + 1, false));
     for(int x = 0; x <= max_x; ++x){
         for(int y = 0; y <= max_y; ++y){
             // if wall is not built and not filled
             if (!grid[x][y].built && !grid[x][y].filled) {
-                // reset visited vector and check if wall can be filled
-                std::fill(visited.begin(), visited.end(), std::vector<bool>(max_y + 1, false));
-                grid[x][y].filled = check_fill(grid, x, y, max_x, max_y, visited, balls_list);
+                int label = fill.component[x*rows + y];
+                if (label < 0) { label = flood_component(grid, fill, x, y, max_x, max_y); }
+                grid[x][y].filled = fill.fillable[label];
             } else {
                 // if wall is filled but not complete and nothing is currently being built
                 if(grid[x][y].filled && !grid[x][y].complete && !walls_black_building && !walls_white_building) {
@@ -396,6 +534,10 @@ void update_game_state(const options &parameters, state &game_state, timer &fps,
                     grid[x][y].active = true;
                     grid[x][y].built = true;
                     grid[x][y].complete = true;
+
+                    // the new wall can split components, so cells after it are labelled again
+                    std::fill(fill.component.begin(), fill.component.end(), -1);
+                    fill.fillable.clear();
                 }
             }
         }
@@ -403,53 +545,305 @@ void update_game_state(const options &parameters, state &game_state, timer &fps,
 
     // set capture percentage
     game_state.current_percentage = float(walls_list.size()) / float(grid.size()*grid[0].size()) * 100.0;
-    // check if percentage target has be reached
-    if (game_state.current_percentage > parameters.PERCENTAGE_TARGET) {
-        if (!level_timer.is_started()) {
-            // advance to next level
-            level_timer.start();
-
-            // check if player has won the game
-            if (game_state.current_level + 1 > 50) {
-                handle_endgame(true, game_winner_surface, game_winner_animation_surface, game_state, fps, quit_timer, walls_list, walls_to_build_black, walls_to_build_white, walls_black_buffer, walls_white_buffer, balls_list, ball_timer);
-                return;
-            } else { ++game_state.current_level; }
-
-            fps.pause();
-            ball_timer.pause();
+}
+
+scene update_game_state(const options &parameters, simulation &sim) {
+    trace_zone zone("update_game_state");
+
+    // fill captured areas and set capture percentage, put off on frames without time to spare unless runs must be reproducible
+    if (scheduler.admit(TASK_FILL, physics_fixed)) {
+        fill_handle(sim.game_state, sim.grid, sim.walls_list, sim.walls_black_building, sim.walls_white_building, sim.balls_list, sim.fill);
+        scheduler.done(TASK_FILL);
+    }
+
+    // check if percentage target has be reached, and if player has won the game
+    if (sim.game_state.current_percentage > parameters.PERCENTAGE_TARGET) {
+        return (sim.game_state.current_level + 1 > MAX_LEVEL) ? scene::won : scene::level_complete;
+    }
+
+    // check if player is out of lives
+    if (sim.game_state.current_lives <= 0) { return scene::lost; }
+
+    return scene::playing;
+}
+
+// SCENES
+// a scene sets up what it shows when entered, then handles one frame each time it is resumed
+const unsigned int ENDGAME_FLASH_MS = 750;
+
+struct board_events {
+    // events routed to a tiled board for its next frame
+    std::vector<SDL_Event> queue;
+    std::size_t read = 0;
+};
+
+struct scene_context {
+    // what the scenes share with the main loop
+    const options &parameters;
+    simulation &sim;
+    level_loader &loader;
+    rewind_buffer &history;
+    scene_scheduler &scenes;
+
+    // events of a tiled board, the scenes poll SDL when there are none
+    board_events* events = NULL;
+
+    orientation wall_orientation = orientation::vertical;
+    overlay screen_overlay = overlay::none;
+
+    // leave a paused scene on its next frame without an event, set by the autoplay agent
+    bool resume = false;
+};
+
+bool next_event(scene_context &ctx) {
+    // take the next event into event
+    if (ctx.events == NULL) { return SDL_PollEvent(&event); }
+    if (ctx.events->read == ctx.events->queue.size()) { return false; }
+    event = ctx.events->queue[ctx.events->read++];
+    return true;
+}
+
+bool paused_events(scene_context &ctx) {
+    // events while nothing moves, returns true if play resumes
+    trace_zone zone("poll_events");
+    bool resumed = std::exchange(ctx.resume, false);
+    while (next_event(ctx)) {
+        if (resume_event()) { resumed = true; }
+
+        // zoom and scroll
+        scale_mouse_event(event);
+        camera_handle(event);
+
+        // scrub through recent ticks
+        rewind_handle(ctx.history);
+
+        // check for quit
+        if (event.type == SDL_QUIT) { ctx.sim.game_state.quit = true; }
+    }
+    return resumed;
+}
+
+scene_task playing_scene(scene_context &ctx) {
+    simulation &sim = ctx.sim;
+    sim.ball_timer.unpause();
+    sim.build_timer.unpause();
+    ctx.screen_overlay = overlay::none;
+
+    while (!sim.game_state.quit) {
+        co_await ctx.scenes.next_frame();
+
+        // set cursor, tiled boards leave it to the main loop
+        if (ctx.events == NULL) { SDL_SetCursor((ctx.wall_orientation == orientation::vertical) ? cursor_vertical : cursor_horizontal); }
+
+        // EVENTS LOOP
+        trace_zone events_zone("poll_events");
+        bool paused = false;
+        while (!paused && next_event(ctx)) {
+
+            // clicks land on the scaled window, the grid is in 800x600, and on the board through the camera
+            scale_mouse_event(event);
+            camera_handle(event);
+
+            // check for pause, later events wait for the paused scene
+            paused = pause_event();
+            if (!paused) {
+
+                // handle button
+                button_handle(sim.grid, sim.walls_list, sim.occupancy, sim.walls_to_build_black, sim.walls_to_build_white, ctx.wall_orientation, sim.build_timer.get_ticks());
+
+                // handle orientation
+                orientation_handle(ctx.wall_orientation);
+            }
+
+            // toggle engine stats overlay
+            stats_handle(sim.game_state);
+
+            // check for quit
+            if (event.type == SDL_QUIT) { sim.game_state.quit = true; }
         }
+        events_zone.end();
+        if (paused) { co_return scene::paused; }
+
+        // LOGIC
+        // build black and white walls
+        build_walls(ctx.parameters, sim.build_timer, sim.grid, sim.walls_list, sim.walls_to_build_black, sim.walls_black_buffer, sim.walls_black_building);
+        build_walls(ctx.parameters, sim.build_timer, sim.grid, sim.walls_list, sim.walls_to_build_white, sim.walls_white_buffer, sim.walls_white_building);
+
+        // handle balls
+        ball_handle(sim.game_state, sim.balls_list, sim.ball_timer, sim.walls_list, sim.walls_to_build_black, sim.walls_to_build_white, sim.walls_black_buffer, sim.walls_white_buffer, sim.regions, sim.kinetic);
+
+        // update game state
+        const scene next = update_game_state(ctx.parameters, sim);
+
+        // keep the tick for rewinding
+        ctx.history.record(sim.game_state, sim.walls_list, sim.balls_list);
+
+        if (next != scene::playing) { co_return next; }
+    }
+    co_return scene::quit;
+}
+
+scene_task paused_scene(scene_context &ctx) {
+    ctx.sim.ball_timer.pause();
+    ctx.sim.build_timer.pause();
+    ctx.screen_overlay = overlay::pause;
 
-        // render level complete image
-        SDL_FillRect(screen, NULL, 0x000000);
-        SDL_BlitSurface(background_surface, NULL, screen, NULL);
-        hud_handle(game_state);
-        wall_handle(walls_list);
-        ball_handle(game_state, balls_list, ball_timer, walls_list, walls_to_build_black, walls_to_build_white, walls_black_buffer, walls_white_buffer);
-        apply_surface((SCREEN_WIDTH-level_complete_surface->w)/2, (SCREEN_HEIGHT-level_complete_surface->h)/2, level_complete_surface, screen);
-        SDL_Flip(screen);
-        
-        // wait until game is resumed
-        if (!fps.is_paused()) {
-            level_timer.stop();
-            game_state.current_percentage = 0;
-            game_state.current_lives = parameters.STARTING_LIVES;
+    while (!ctx.sim.game_state.quit) {
+        co_await ctx.scenes.next_frame(true);
+        if (paused_events(ctx)) {
+            ctx.history.stop_scrubbing();
+            co_return scene::playing;
+        }
+    }
+    co_return scene::quit;
+}
+
+scene_task level_complete_scene(scene_context &ctx) {
+    simulation &sim = ctx.sim;
+
+    // spawn the next level in the background while the overlay is shown
+    ++sim.game_state.current_level;
+    ctx.loader.start(ctx.parameters, sim.game_state);
+    sim.ball_timer.pause();
+    sim.build_timer.pause();
+    ctx.screen_overlay = overlay::level_complete;
+
+    // wait until game is resumed
+    while (!sim.game_state.quit) {
+        co_await ctx.scenes.next_frame(true);
+        if (paused_events(ctx)) {
+            ctx.history.stop_scrubbing();
+            sim.game_state.current_percentage = 0;
+            sim.game_state.current_lives = ctx.parameters.STARTING_LIVES;
             // reset walls
-            walls_list.clear();
-            // reset buttons
-            for (std::vector<button> &row : grid) {
-                for (button &cell : row) {
-                    cell.reset();
-                }
+            sim.walls_list.clear();
+            // swap in reset buttons and new balls, they start moving on the next frame
+            ctx.loader.finish(sim.grid, sim.balls_list);
+            sim.ball_timer.start();
+            co_return scene::playing;
+        }
+    }
+    co_return scene::quit;
+}
+
+scene_task flash_overlay(scene_context &ctx, bool win) {
+    // animate screen until the game quits
+    while (true) {
+        ctx.screen_overlay = win ? overlay::game_winner : overlay::game_over;
+        co_await ctx.scenes.wait(ENDGAME_FLASH_MS);
+        ctx.screen_overlay = win ? overlay::game_winner_animation : overlay::game_over_animation;
+        co_await ctx.scenes.wait(ENDGAME_FLASH_MS);
+    }
+}
+
+scene_task endgame_scene(scene_context &ctx, bool win) {
+    simulation &sim = ctx.sim;
+    sim.ball_timer.stop();
+    ctx.scenes.spawn(flash_overlay(ctx, win));
+
+    while (!sim.game_state.quit) {
+        // move balls
+        ball_handle(sim.game_state, sim.balls_list, sim.ball_timer, sim.walls_list, sim.walls_to_build_black, sim.walls_to_build_white, sim.walls_black_buffer, sim.walls_white_buffer, sim.regions, sim.kinetic);
+
+        // wait for quit or escape key to exit
+        while (next_event(ctx)) {
+            if ((event.type == SDL_QUIT) || ((event.type == SDL_KEYDOWN) && (event.key.keysym.sym == SDLK_ESCAPE))) {
+                sim.game_state.quit = true;
+                break;
             }
-            // reset balls
-            balls_list.clear();
-            ball_init(parameters, game_state, balls_list);
         }
+        co_await ctx.scenes.next_frame();
     }
+    co_return scene::quit;
+}
 
-    // check if player is out of lives
-    if (game_state.current_lives <= 0) {
-        handle_endgame(false, game_over_surface, game_over_animation_surface, game_state, fps, quit_timer, walls_list, walls_to_build_black, walls_to_build_white, walls_black_buffer, walls_white_buffer, balls_list, ball_timer);
-        return;
+scene_task run_scenes(scene_context &ctx) {
+    // each scene returns the one to go to next
+    scene next = scene::playing;
+    while (next != scene::quit) {
+        ctx.scenes.enter(next);
+        switch (next) {
+            case scene::playing: next = co_await playing_scene(ctx); break;
+            case scene::paused: next = co_await paused_scene(ctx); break;
+            case scene::level_complete: next = co_await level_complete_scene(ctx); break;
+            case scene::won: next = co_await endgame_scene(ctx, true); break;
+            case scene::lost: next = co_await endgame_scene(ctx, false); break;
+            case scene::quit: break;
+        }
     }
+    ctx.scenes.enter(scene::quit);
+    co_return scene::quit;
+}
+
+activity scene_activity(scene current) {
+    // what the cpu meter charges a frame of the scene to
+    switch (current) {
+        case scene::playing: return ACTIVITY_RUNNING;
+        case scene::won: case scene::lost: return ACTIVITY_ENDGAME;
+        default: return ACTIVITY_IDLE;
+    }
+}
+
+spectator_status spectate_status(scene current) {
+    switch (current) {
+        case scene::paused: return spectator_status::paused;
+        case scene::level_complete: return spectator_status::level_complete;
+        case scene::won: return spectator_status::won;
+        case scene::lost: return spectator_status::lost;
+        default: return spectator_status::playing;
+    }
+}
+
+void spectate_handle(spectator_feed &feed, const state &game_state, const std::vector<wall> &walls_list, const std::vector<ball> &balls_list, scene current) {
+    // publish the frame for spectators
+    if (!feed.is_open()) { return; }
+    trace_zone zone("spectate");
+    feed.begin();
+    std::uint8_t* cells = feed.cells();
+    for (const wall &w : walls_list) { cells[playfield_cell(w.hitbox.x, w.hitbox.y)] = w.colour ? SPECTATE_BLACK : SPECTATE_WHITE; }
+    std::size_t balls = balls_list.size();
+    std::int16_t* positions = feed.balls(balls);
+    for (std::size_t n = 0; n < balls; ++n) {
+        positions[2 * n] = int(balls_list[n].x_pos) - GRID_X_OFFSET;
+        positions[2 * n + 1] = int(balls_list[n].y_pos) - GRID_Y_OFFSET;
+    }
+    feed.publish(spectator_hud{game_state.frame, game_state.current_level, game_state.current_lives, game_state.current_percentage, spectate_status(current)});
+}
+
+// EXIT
+int exit_reports(const options &parameters, const frame_encoder &encoder) {
+    // print and write what was asked for on the command line, returns the exit status
+
+    // report frame export
+    if (!parameters.EXPORT_FILE.empty()) {
+        std::cout << "exported " << encoder.written() << " frames to " << parameters.EXPORT_FILE << " (" << encoder.stalled() << " waits on the encoder)" << std::endl;
+    }
+
+    // report deferred work
+    if (scheduler.is_enabled()) { scheduler.report(std::cout); }
+
+    // report heap allocations
+    if (parameters.ALLOC_CHECK) { allocations.report(std::cout); }
+
+    // report cpu usage
+    if (parameters.CPU_REPORT) { cpu.report(std::cout); }
+
+    // export trace zones
+    if (!parameters.TRACE_FILE.empty() && !trace.write_json(parameters.TRACE_FILE)) {
+        std::cerr << "error: could not write trace to " << parameters.TRACE_FILE << std::endl;
+    }
+
+    // export engine counters
+    if (!parameters.STATS_FILE.empty() && !stats.write_json(parameters.STATS_FILE)) {
+        std::cerr << "error: could not write stats to " << parameters.STATS_FILE << std::endl;
+    }
+
+    // report unattended play
+    if (soak.is_enabled()) { soak.report(std::cout); }
+
+    // fail allocation check and soak test
+    if (parameters.ALLOC_CHECK && !allocations.passed()) { return 1; }
+    if (soak.is_enabled() && !soak.passed()) { return 1; }
+
+    return 0;
 }
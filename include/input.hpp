@@ -3,6 +3,7 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <array>
 #include <unordered_set>
 #include <sstream>
 #include <iterator>
@@ -11,6 +12,9 @@
 #include <numeric>
 #include <cstdlib>
 #include <stdexcept>
+#include <cstdint>
+#include <bit>
+#include <span>
 
 // SDL GLOBAL VARIABLES
 const int SCREEN_WIDTH = 800;
@@ -31,9 +35,13 @@ const int PERCENTAGE_DIGIT_2_OFFSET = 660;
 
 const int FPS_CAP = 60;
 
-SDL_Event event;
+const unsigned int MAX_LEVEL = 50;
+
+// tiled boards handle their events on worker threads, each with its own current event
+thread_local SDL_Event event;
 
 SDL_Surface* screen = NULL;
+SDL_Surface* window_surface = NULL;
 SDL_Surface* background_surface = NULL;
 SDL_Surface* pause_surface = NULL;
 SDL_Surface* level_complete_surface = NULL;
@@ -51,8 +59,13 @@ SDL_Cursor* cursor_vertical = NULL;
 std::unordered_set<SDL_Surface*> surface_array{background_surface, pause_surface, level_complete_surface, game_over_surface, game_over_animation_surface, game_winner_surface, game_winner_animation_surface, balls_surface, wall_black, wall_white, digits_surface};
 std::unordered_set<SDL_Cursor*> cursor_array{cursor_horizontal, cursor_vertical};
 
+enum class scale_filter : bool {
+    nearest,
+    bilinear,
+};
+
 // CLASS FORWARD DECLARATIONS
-class timer; class button; class wall; class ball;
+class timer; class button; class wall; class ball; class wall_occupancy;
 
 struct options {
     unsigned int LEVEL_SELECT = 1;
@@ -64,6 +77,26 @@ struct options {
     const unsigned int BUILD_SPEED_MODIFIER = 400; // in pixels per second
     const unsigned int PERCENTAGE_TARGET = 75;
     std::pair<int, int> RESOLUTION = {800, 600}; // {width, height} in pixels 
+    scale_filter SCALE_FILTER = scale_filter::nearest; // how the 800x600 frame is scaled to the resolution
+    bool RENDER_THREAD = false; // composite and flip on a separate thread
+    bool INDEXED_RENDER = false; // composite frames in 8 bits against a palette of the artwork, expanded to the window when presented
+    std::string STATS_FILE = ""; // engine counters are written here on exit
+    std::string TRACE_FILE = ""; // trace zones are written here on exit
+    bool HEADLESS = false; // composite offscreen and run uncapped on a fixed timestep
+    std::string EXPORT_FILE = ""; // composited frames are written here, raw rgb24 or a ppm sequence if it contains %d
+    unsigned long FRAME_LIMIT = 0; // quit after this many frames, 0 runs until quit
+    unsigned int FORK_BENCHMARK = 0; // fork and roll out the starting level this many times, then quit
+    bool FIXED_PHYSICS = false; // move balls in fixed point so trajectories are bit exact across builds and machines
+    bool KINETIC_PHYSICS = false; // move balls between predicted collisions instead of testing for them every tick
+    bool CPU_REPORT = false; // print cpu usage while running, paused and in the endgame on exit
+    std::string SCENARIO_FILE = ""; // board, balls and scripted input are loaded from here instead of spawned
+    unsigned int FRAME_BUDGET = 0; // in milliseconds, deferrable work is spread across frames to stay within it, 0 disables
+    bool ALLOC_CHECK = false; // report heap allocations per phase and fail if a steady state frame allocates
+    unsigned int REWIND_MEGABYTES = 32; // history of recent ticks kept for scrubbing while paused, 0 disables
+    std::string CONTROL = ""; // commands are answered here instead of playing, "-" for stdin and stdout or a unix socket path
+    std::string SPECTATE = ""; // every frame is published to shared memory of this name for spectator tools
+    unsigned int BOARDS = 1; // independent games tiled in the window, simulated in parallel
+    unsigned long AUTOPLAY = 0; // play unattended and log a soak test report every this many frames, 0 disables
 };
 
 struct state {
@@ -71,6 +104,12 @@ struct state {
     unsigned int current_lives = 0;
     float current_percentage = 0;
     bool quit = false;
+    bool show_stats = false;
+    unsigned long frame = 0;
+    std::uint64_t trajectory_hash = TRAJECTORY_HASH_SEED;
+
+    // milliseconds the balls moved on the last tick
+    unsigned int tick_ms = 0;
 };
 
 enum class orientation : bool {
@@ -106,9 +145,6 @@ class button {
         // collision box
         SDL_Rect hitbox;
 
-        // vector containing collision box
-        std::vector<SDL_Rect> hitbox_vector;
-
         // coordinates of button
         std::pair<int, int> pos;
 
@@ -119,18 +155,18 @@ class button {
         bool filled;
         bool complete;
 
-        // building delay
-        timer delay_timer;
+        // building delay, the cell is built delay_counter steps after the build timer read queued_at
+        int queued_at;
         int delay_counter;
         
     public:
         button(int x, int y, int w, int h, std::pair<int, int> p);
         
         // handle wall building
-        void handle(std::vector<std::vector<button>> &grid, std::vector<wall> &walls_list, std::vector<button> &walls_to_build_black, std::vector<button> &walls_to_build_white, orientation &wall_orientation);
+        void handle(std::vector<std::vector<button>> &grid, std::vector<wall> &walls_list, wall_occupancy &occupancy, std::vector<button> &walls_to_build_black, std::vector<button> &walls_to_build_white, orientation &wall_orientation, int now);
 
-        // check if adjacent wall can be built
-        void check_adjacent_wall(std::vector<std::vector<button>> &grid, std::vector<wall> &walls_list, std::vector<button> &walls_to_build_black, std::vector<button> &walls_to_build_white, std::pair<int, int> pos, bool orig_flag, bool next_flag, int counter, orientation wall_orientation);
+        // queue a cell of a new wall, counter cells away from where it was placed, now on the build timer
+        void queue_wall(std::vector<button> &walls_to_build, bool next_flag, int counter, int now);
 
         // return index on grid
         int col() const;
@@ -165,7 +201,7 @@ class wall {
 class ball {  
     public:
         // dimensions
-        const int rad = balls_surface->w;
+        int rad = balls_surface->w;
 
         // position
         float x_pos, y_pos;
@@ -173,23 +209,290 @@ class ball {
         // speed
         float x_speed, y_speed;
 
+        // position and speed in fixed point, authoritative while physics_fixed is set
+        fixed x_fixed, y_fixed;
+        fixed x_speed_fixed, y_speed_fixed;
+
     public:   
-        // collision box
-        std::vector<SDL_Rect> hitbox;
+        // collision box, stored inline so balls can be copied without allocating
+        std::array<SDL_Rect, 11> hitbox;
+
+        // walls touched since the last wall collision check
+        static const int MAX_CONTACTS = 4;
+        SDL_Rect contacts[MAX_CONTACTS];
+        int contact_count;
 
         ball(int x, int y, int speed);
 
-        // update position with respect to speed
-        void update(timer &ball_timer);
+        // update position with respect to speed, reflecting off walls and boundaries at time of impact
+        void update(int dt_ms, std::span<const wall> walls);
+
+        // same as update in fixed point
+        void update_fixed(int dt_ms, std::span<const wall> walls);
+
+        // fixed point responses to overlapping another ball or a wall
+        void bounce_fixed(ball &other_ball);
+        void push_out_fixed(const SDL_Rect &w);
+
+        // mirror fixed point position and speed into the float fields read by rendering and filling
+        void sync_fixed();
 
         // update hitbox with respect to position
         void shift_boxes();
        
         // offset slightly to ensure balls don't get stuck in each other
         void set_direction(float &pos, float &other_pos);
+        void set_direction_fixed(fixed &pos, fixed &other_pos);
 
         // set position and hitbox
         void set_position(float x, float y);
+
+        // set speed in pixels per second
+        void set_speed(float x, float y);
+};
+
+struct fill_workspace {
+    // per cell, component label of open cells or -1, and whether a ball is close enough to stop filling
+    std::vector<int> component;
+    std::vector<unsigned char> near_ball;
+
+    // per component, whether it can fill
+    std::vector<unsigned char> fillable;
+
+    // cells waiting to be flooded
+    std::vector<int> stack;
+};
+
+class wall_occupancy {
+    // built cells as one bitset per row and one per column, kept in step with walls_list
+    private:
+        int cols, rows;
+        int row_words, col_words;
+
+        // bit col of row_bits[row], bit row of col_bits[col]
+        std::vector<std::uint64_t> row_bits;
+        std::vector<std::uint64_t> col_bits;
+
+        // walls of walls_list already set
+        std::size_t synced;
+
+        void clear();
+        void set(int col, int row);
+
+    public:
+        wall_occupancy();
+
+        // set cells of walls added since the last call, walls are only appended until a level is reset, which empties the list
+        void sync(const std::vector<wall> &walls_list);
+
+        bool is_built(int col, int row) const;
+
+        // nearest built cell in the column at or past row going down, rows if there is none
+        int next_in_col(int col, int row) const;
+        // at or before row going up, -1 if there is none
+        int previous_in_col(int col, int row) const;
+
+        // same along a row
+        int next_in_row(int col, int row) const;
+        int previous_in_row(int col, int row) const;
+};
+
+class region_map {
+    // open cells split into the regions walls seal off, each with the walls around it, kept in step with walls_list
+    // balls in different regions can never touch, so a ball only needs testing against its region's balls and walls
+    private:
+        int cols, rows;
+
+        // per cell, region of an open cell or -1 for a built one
+        std::vector<int> label;
+        std::vector<int> stack;
+        int count;
+
+        // walls of walls_list labelled
+        std::size_t synced;
+
+        // walls next to region r, in walls_list order, are walls[wall_start[r]] up to walls[wall_start[r + 1]]
+        std::vector<wall> walls;
+        std::vector<int> wall_start;
+
+        // balls of region r this tick, in balls_list order, are ball_index[ball_start[r]] up to ball_index[ball_start[r + 1]]
+        std::vector<std::size_t> ball_index;
+        std::vector<int> ball_start;
+        std::vector<int> ball_region;
+
+        // every ball in balls_list order, for ticks that cannot be split
+        std::vector<std::size_t> every_ball;
+
+        // label the open cells and gather the walls around each region
+        void relabel(const std::vector<wall> &walls_list);
+
+        // region a ball is inside, -1 if it reaches into another region or its centre is on a built cell
+        int region_of(const ball &b) const;
+
+    public:
+        region_map();
+
+        // relabel if the walls changed and sort the balls into regions, false if a ball is not inside a single region
+        bool sync(const std::vector<wall> &walls_list, const std::vector<ball> &balls_list);
+
+        int regions() const;
+        std::span<const wall> walls_of(int region) const;
+        std::span<const std::size_t> balls_of(int region) const;
+        std::span<const std::size_t> all_balls() const;
+};
+
+struct kinetic_event {
+    // seconds on the engine clock
+    double time;
+
+    // ball it happens to, and the other ball, -1 for a wall or the playfield edge or -2 for the centre crossing into another neighbour cell
+    int ball, other;
+
+    // velocity changes of both balls when it was predicted, it is stale once the ball changed again
+    unsigned int count, other_count;
+
+    // wall or touch prediction of the ball it belongs to, stale once the ball's walls or touches were predicted again
+    unsigned int stamp;
+
+    // axes reflected, the column and row entered, and the cell hit, outside the grid for the playfield edge
+    // a crossing enters the neighbour cell at column and row
+    bool x_axis, y_axis;
+    int col, row;
+    int hit_col, hit_row;
+};
+
+class kinetic_engine {
+    // event driven ball physics, balls fly in straight lines between collisions predicted ahead of time
+    // a tick only handles the collisions that fall within it instead of testing every ball against everything
+    private:
+        struct motion {
+            // position at time start, speed in pixels per second and size in pixels
+            double x, y, start;
+            double x_speed, y_speed;
+            int rad;
+
+            // velocity changes and wall predictions so far, and when the predicted wall is hit
+            unsigned int count, stamp;
+            double wall_time;
+
+            // touch predictions so far, and when the earliest predicted touch is, only that one is queued
+            unsigned int pair_stamp;
+            double pair_time;
+
+            // neighbour cell the centre is in, and the balls before and after it in the cell's list
+            int cell_col, cell_row;
+            int cell_prev, cell_next;
+
+            // what the last tick wrote into balls_list, so balls moved by anything else are noticed
+            float x_written, y_written, x_speed_written, y_speed_written;
+        };
+
+        int cols, rows;
+
+        // per cell, whether it is built, kept in step with walls_list
+        std::vector<unsigned char> built;
+        std::size_t synced;
+
+        std::vector<motion> motions;
+
+        // neighbour grid over the playfield, cells are wider than a ball so balls that touch have centres in the same or adjacent cells
+        int side, grid_cols, grid_rows;
+        std::vector<int> cell_heads;
+
+        // predicted collisions as a min heap on time, at most a wall, a crossing and a touch per ball are live, stale ones are dropped when they come up
+        std::vector<kinetic_event> queue;
+
+        // engine clock in seconds
+        double now;
+
+        // cell outside the grid or built
+        bool blocked(int col, int row) const;
+
+        // position of a ball now
+        double x_at(const motion &m) const;
+        double y_at(const motion &m) const;
+
+        // move a ball's start to now
+        void settle(motion &m);
+
+        // queue an event, dropping stale ones first if the queue is full
+        void push(const kinetic_event &e);
+        bool is_stale(const kinetic_event &e) const;
+
+        // neighbour cell a ball's centre is in, and adding it to or taking it out of that cell's list
+        int grid_col(const motion &m) const;
+        int grid_row(const motion &m) const;
+        void link(int n);
+        void unlink(int n);
+
+        // next wall or playfield edge a ball hits
+        void predict_walls(int n);
+
+        // next time the centre crosses into another neighbour cell
+        void predict_crossing(int n);
+
+        // next time two balls touch, infinity if they do not on their current paths before either turns at a wall
+        double pair_time(int n, int other) const;
+
+        // earliest touch with the balls around n but skip, replacing the queued one or only if it is sooner
+        void predict_pairs(int n, int skip, bool replace);
+
+        // walls, crossing and touches with the balls around n but skip
+        void predict(int n, int skip);
+
+        // start over from balls_list and walls_list
+        void rebuild(const std::vector<wall> &walls_list, const std::vector<ball> &balls_list);
+
+        // mark walls added since the last tick, and predict again for balls they get in the way of
+        void add_walls(const std::vector<wall> &walls_list);
+
+        // something other than the engine moved, added or removed a ball
+        bool moved_elsewhere(const std::vector<ball> &balls_list) const;
+
+        // handle events up to time, recording walls touched as contacts
+        void advance(double time, std::vector<ball> &balls_list);
+
+    public:
+        kinetic_engine();
+
+        // move balls over a tick of dt_ms
+        void tick(const std::vector<wall> &walls_list, std::vector<ball> &balls_list, int dt_ms);
+};
+
+struct simulation {
+    // everything a tick reads and writes, copying it forks the game
+    state game_state;
+
+    // cells of the playfield
+    std::vector<std::vector<button>> grid;
+
+    // placed walls, walls waiting to be built and walls being built
+    std::vector<wall> walls_list;
+    std::vector<button> walls_to_build_black;
+    std::vector<button> walls_to_build_white;
+    std::vector<button> walls_black_buffer;
+    std::vector<button> walls_white_buffer;
+    bool walls_black_building = false;
+    bool walls_white_building = false;
+
+    // time played on the level, stopped while paused, queued walls are built at delays measured on it
+    timer build_timer;
+
+    // balls and time of their last update
+    std::vector<ball> balls_list;
+    timer ball_timer;
+
+    // storage reused by fill_handle
+    fill_workspace fill;
+
+    // built cells for placing walls
+    wall_occupancy occupancy;
+
+    // sealed regions for ball collisions
+    region_map regions;
+
+    // predicted collisions while physics_kinetic is set
+    kinetic_engine kinetic;
 };
 
 static const char *cursor_horizontal_image[] = {
@@ -324,6 +627,46 @@ void print_command_line_arguments() {
     std::cout << "     Set the colour of the balls in $ballcolour | range [red, blue, green]." << std::endl;
     std::cout << "-res $resolution (=800x600)" << std::endl;
     std::cout << "     Set the resolution of the game window in $resolution | range [4:3 aspect ratio]" << std::endl;
+    std::cout << "-rt" << std::endl;
+    std::cout << "     Render frames on a separate thread while the next tick is simulated." << std::endl;
+    std::cout << "-stats $file" << std::endl;
+    std::cout << "     Write per-frame engine counters and histograms to $file as JSON on exit. F3 toggles the counters overlay." << std::endl;
+    std::cout << "--trace $file" << std::endl;
+    std::cout << "     Write a timeline of the main loop phases to $file in Chrome trace event format on exit." << std::endl;
+    std::cout << "-headless" << std::endl;
+    std::cout << "     Render offscreen without a window and simulate on a fixed timestep as fast as possible." << std::endl;
+    std::cout << "-export $file" << std::endl;
+    std::cout << "     Write every frame to $file as raw rgb24 video, or as numbered ppm images if $file contains %d, or %0Nd to zero pad to N digits." << std::endl;
+    std::cout << "-frames $frames (=0)" << std::endl;
+    std::cout << "     Quit after $frames frames | 0 runs until quit." << std::endl;
+    std::cout << "-forkbench $rollouts" << std::endl;
+    std::cout << "     Report forks and rollout ticks per second over $rollouts random wall placements on the starting level, then quit." << std::endl;
+    std::cout << "-fixed" << std::endl;
+    std::cout << "     Move balls in fixed point so runs are bit exact across builds and machines, and print a trajectory hash on exit." << std::endl;
+    std::cout << "-kinetic" << std::endl;
+    std::cout << "     Move balls with an event driven engine that predicts each collision with a wall, the playfield edge or another ball and only handles those, instead of testing every ball against everything on every tick. Sparse boards then cost in proportion to their collisions." << std::endl;
+    std::cout << "-cpu" << std::endl;
+    std::cout << "     Print the cpu usage of the process while running, paused and in the endgame on exit." << std::endl;
+    std::cout << "-scenario $file" << std::endl;
+    std::cout << "     Load the level, balls, walls, captured regions and scripted input from $file instead of spawning the starting level." << std::endl;
+    std::cout << "-budget $milliseconds (=16)" << std::endl;
+    std::cout << "     Keep each frame's work within $milliseconds by putting off filling, rendering and the caption on heavy frames, and report deferrals on exit." << std::endl;
+    std::cout << "-allocs" << std::endl;
+    std::cout << "     Report heap allocations per phase on exit, and exit with status 1 if a gameplay frame allocated after the first second." << std::endl;
+    std::cout << "-filter $filter (=nearest)" << std::endl;
+    std::cout << "     Scale frames to the resolution with $filter | nearest, bilinear" << std::endl;
+    std::cout << "-indexed" << std::endl;
+    std::cout << "     Composite frames at 8 bits per pixel against a palette built from the artwork, and expand them to the window's format when they are shown." << std::endl;
+    std::cout << "-rewind $megabytes (=32)" << std::endl;
+    std::cout << "     Keep the last ticks of play in $megabytes of memory. While paused, the arrow keys scrub back and forward by a tick and the brackets by a second | 0 disables." << std::endl;
+    std::cout << "-control $socket" << std::endl;
+    std::cout << "     Run headless and answer place, step, state, snapshot, next and quit commands, one per line, on a unix socket at $socket or on stdin and stdout if $socket is omitted." << std::endl;
+    std::cout << "-spectate $name (=/jezzball)" << std::endl;
+    std::cout << "     Publish every frame's balls, board and hud to shared memory named $name, for jezzball_spectate and other spectator tools." << std::endl;
+    std::cout << "-boards $boards (=1)" << std::endl;
+    std::cout << "     Play $boards independent games tiled in the window, simulated in parallel. Clicks go to the board under the cursor, which then also gets the keys | range [1, 16]." << std::endl;
+    std::cout << "-autoplay $frames (=3600)" << std::endl;
+    std::cout << "     Play unattended for soak testing, placing walls, completing levels and starting over after the endgame. Every $frames frames, log frame time percentiles, resident memory and allocations. Balls leaving the playfield or entering captured cells, frames over budget and memory growth are flagged, and make the exit status 1." << std::endl;
 }
 
 void parse_command_line_arguments(int argc, char* argv[], options &parameters) {
@@ -413,6 +756,158 @@ void parse_command_line_arguments(int argc, char* argv[], options &parameters) {
                     throw std::invalid_argument("error: resolution must be 4:3 aspect ratio");
                 }
 
+            // SCALE FILTER
+            } else if (arg.substr(0,7) == "-filter") {
+                std::string filter = arg.substr(7);
+                if (filter == "nearest") {
+                    parameters.SCALE_FILTER = scale_filter::nearest;
+                } else if (filter == "bilinear") {
+                    parameters.SCALE_FILTER = scale_filter::bilinear;
+                } else {
+                    throw std::invalid_argument("error: filter must be nearest or bilinear");
+                }
+
+            // RENDER THREAD
+            } else if (arg.substr(0,3) == "-rt") {
+                parameters.RENDER_THREAD = true;
+
+            // INDEXED RENDER
+            } else if (arg.substr(0,8) == "-indexed") {
+                parameters.INDEXED_RENDER = true;
+
+            // ENGINE STATS
+            } else if (arg.substr(0,6) == "-stats") {
+                std::string filename = arg.substr(6);
+                if (filename.empty()) {
+                    throw std::invalid_argument("error: stats file name must follow -stats");
+                }
+                parameters.STATS_FILE = filename;
+
+            // TRACE
+            } else if (arg == "--trace") {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument("error: trace file name must follow --trace");
+                }
+                parameters.TRACE_FILE = argv[++i];
+
+            // HEADLESS
+            } else if (arg.substr(0,9) == "-headless") {
+                parameters.HEADLESS = true;
+
+            // FRAME EXPORT
+            } else if (arg.substr(0,7) == "-export") {
+                std::string filename = arg.substr(7);
+                if (filename.empty()) {
+                    throw std::invalid_argument("error: export file name must follow -export");
+                }
+                parameters.EXPORT_FILE = filename;
+
+            // FRAME LIMIT
+            } else if (arg.substr(0,7) == "-frames") {
+                try {
+                    parameters.FRAME_LIMIT = std::stoul(arg.substr(7));
+                } catch (const std::exception& e) {
+                    throw std::invalid_argument("error: frame limit must be a non-negative integer");
+                }
+
+            // FORK BENCHMARK
+            } else if (arg.substr(0,10) == "-forkbench") {
+                try {
+                    int rollouts = std::stoi(arg.substr(10));
+                    if (rollouts >= 1) {
+                        parameters.FORK_BENCHMARK = rollouts;
+                    } else {
+                        throw std::invalid_argument("error: fork benchmark rollouts must be at least 1");
+                    }
+                } catch (const std::exception& e) {
+                    throw std::invalid_argument("error: fork benchmark rollouts must be at least 1");
+                }
+
+            // FIXED POINT PHYSICS
+            } else if (arg.substr(0,6) == "-fixed") {
+                parameters.FIXED_PHYSICS = true;
+
+            // KINETIC PHYSICS
+            } else if (arg.substr(0,8) == "-kinetic") {
+                parameters.KINETIC_PHYSICS = true;
+
+            // CPU REPORT
+            } else if (arg.substr(0,4) == "-cpu") {
+                parameters.CPU_REPORT = true;
+
+            // SCENARIO
+            } else if (arg.substr(0,9) == "-scenario") {
+                std::string filename = arg.substr(9);
+                if (filename.empty()) {
+                    throw std::invalid_argument("error: scenario file name must follow -scenario");
+                }
+                parameters.SCENARIO_FILE = filename;
+
+            // FRAME BUDGET
+            } else if (arg.substr(0,7) == "-budget") {
+                try {
+                    int budget = arg.size() > 7 ? std::stoi(arg.substr(7)) : 1000 / FPS_CAP;
+                    if (budget >= 1) {
+                        parameters.FRAME_BUDGET = budget;
+                    } else {
+                        throw std::invalid_argument("error: frame budget must be at least 1 ms");
+                    }
+                } catch (const std::exception& e) {
+                    throw std::invalid_argument("error: frame budget must be at least 1 ms");
+                }
+
+            // ALLOCATION CHECK
+            } else if (arg.substr(0,7) == "-allocs") {
+                parameters.ALLOC_CHECK = true;
+
+            // REWIND
+            } else if (arg.substr(0,7) == "-rewind") {
+                try {
+                    int megabytes = std::stoi(arg.substr(7));
+                    if (megabytes >= 0 && megabytes <= 4096) {
+                        parameters.REWIND_MEGABYTES = megabytes;
+                    } else {
+                        throw std::invalid_argument("error: rewind buffer must be in range [0, 4096] megabytes");
+                    }
+                } catch (const std::exception& e) {
+                    throw std::invalid_argument("error: rewind buffer must be in range [0, 4096] megabytes");
+                }
+
+            // CONTROL
+            } else if (arg.substr(0,8) == "-control") {
+                parameters.CONTROL = arg.size() > 8 ? arg.substr(8) : "-";
+                parameters.HEADLESS = true;
+
+            // SPECTATOR FEED
+            } else if (arg.substr(0,9) == "-spectate") {
+                parameters.SPECTATE = arg.size() > 9 ? arg.substr(9) : "/jezzball";
+
+            // TILED BOARDS
+            } else if (arg.substr(0,7) == "-boards") {
+                try {
+                    int boards = std::stoi(arg.substr(7));
+                    if (boards >= 1 && boards <= 16) {
+                        parameters.BOARDS = boards;
+                    } else {
+                        throw std::invalid_argument("error: boards must be in range [1, 16]");
+                    }
+                } catch (const std::exception& e) {
+                    throw std::invalid_argument("error: boards must be in range [1, 16]");
+                }
+
+            // AUTOPLAY
+            } else if (arg.substr(0,9) == "-autoplay") {
+                try {
+                    long frames = arg.size() > 9 ? std::stol(arg.substr(9)) : 60 * FPS_CAP;
+                    if (frames >= 1 && frames <= 1000000) {
+                        parameters.AUTOPLAY = frames;
+                    } else {
+                        throw std::invalid_argument("error: autoplay report interval must be in range [1, 1000000] frames");
+                    }
+                } catch (const std::exception& e) {
+                    throw std::invalid_argument("error: autoplay report interval must be in range [1, 1000000] frames");
+                }
+
             // HELP
             } else if (arg.substr(0,6) == "--help") {
                 print_command_line_arguments();
@@ -426,6 +921,29 @@ void parse_command_line_arguments(int argc, char* argv[], options &parameters) {
         }
     }
 
+    // tiled boards run their own loop, without the modes built around a single game
+    if (parameters.BOARDS > 1 && (!parameters.CONTROL.empty() || !parameters.SCENARIO_FILE.empty() || parameters.FORK_BENCHMARK > 0 || !parameters.SPECTATE.empty() || parameters.FRAME_BUDGET > 0 || parameters.RENDER_THREAD)) {
+        std::cerr << "error: -boards cannot be combined with -control, -scenario, -forkbench, -spectate, -budget or -rt" << std::endl;
+        std::exit(1);
+    }
+
+    // the agent plays the single game of the main loop
+    if (parameters.AUTOPLAY > 0 && (!parameters.CONTROL.empty() || !parameters.SCENARIO_FILE.empty() || parameters.FORK_BENCHMARK > 0 || parameters.BOARDS > 1)) {
+        std::cerr << "error: -autoplay cannot be combined with -control, -scenario, -forkbench or -boards" << std::endl;
+        std::exit(1);
+    }
+
+    // the render thread drops snapshots it has not picked up yet, so an export would skip frames
+    if (parameters.RENDER_THREAD && !parameters.EXPORT_FILE.empty()) {
+        std::cerr << "error: -rt cannot be combined with -export" << std::endl;
+        std::exit(1);
+    }
+
+    // the kinetic engine moves balls in float between events
+    if (parameters.KINETIC_PHYSICS && parameters.FIXED_PHYSICS) {
+        std::cerr << "error: -kinetic cannot be combined with -fixed" << std::endl;
+        std::exit(1);
+    }
 
     // std::cout << "starting level: " << parameters.LEVEL_SELECT << std::endl;
     // std::cout << "starting lives: " << parameters.STARTING_LIVES << std::endl;
@@ -0,0 +1,394 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// KINETIC PHYSICS
+// -kinetic moves balls in straight lines between collisions predicted ahead of time and kept in a priority queue
+// each ball has its next wall predicted by walking the cells its box enters, and its next touch solved for against the balls in the neighbour cells around it
+// balls are kept in a list per neighbour cell and move between lists as their centres cross, so an event costs the balls nearby rather than every ball
+// balls are circles to each other and boxes to walls, both reflect along the axes they meet on so balls keep their diagonals
+
+// balls move on the kinetic engine clock instead of the frame stepped update while set
+bool physics_kinetic = false;
+
+// ball_handle moves every ball twice a tick, the kinetic clock runs at the same pace
+const double KINETIC_PACE = 2.0;
+
+// in cells, how far a box edge may be past a cell border and still not cover the cell
+const double KINETIC_EPSILON = 1e-9;
+
+// in seconds, column and row crossings this close together are entered at once, as a corner
+const double KINETIC_TIE = 1e-9;
+
+// events a ball can have live at once, its next wall, its next crossing and its earliest touch
+const std::size_t KINETIC_LIVE_EVENTS = 3;
+
+// queue room per live event, stale events are dropped to make room when it fills
+const std::size_t KINETIC_QUEUE_ROOM = 2;
+
+// event other ball for a centre crossing into another neighbour cell
+const int KINETIC_CROSSING = -2;
+
+bool kinetic_later(const kinetic_event &a, const kinetic_event &b) { return a.time > b.time; }
+
+// KINETIC ENGINE CLASS
+kinetic_engine::kinetic_engine() {
+    cols = (SCREEN_WIDTH - 2*GRID_X_OFFSET) / GRID_DIM;
+    rows = (SCREEN_HEIGHT - 2*GRID_Y_OFFSET) / GRID_DIM;
+    synced = 0;
+    now = 0;
+    side = GRID_DIM;
+    grid_cols = grid_rows = 0;
+}
+bool kinetic_engine::blocked(int col, int row) const {
+    return col < 0 || row < 0 || col >= cols || row >= rows || built[col*rows + row];
+}
+double kinetic_engine::x_at(const motion &m) const { return m.x + m.x_speed * (now - m.start); }
+double kinetic_engine::y_at(const motion &m) const { return m.y + m.y_speed * (now - m.start); }
+void kinetic_engine::settle(motion &m) {
+    m.x = x_at(m);
+    m.y = y_at(m);
+    m.start = now;
+}
+bool kinetic_engine::is_stale(const kinetic_event &e) const {
+    // a touch whose other ball turned since is not stale, it is when the ball looks for its next touch again
+    const motion &m = motions[e.ball];
+    if (e.other == KINETIC_CROSSING) { return m.count != e.count; }
+    if (e.other < 0) { return m.stamp != e.stamp; }
+    return m.count != e.count || m.pair_stamp != e.stamp;
+}
+int kinetic_engine::grid_col(const motion &m) const { return std::clamp(int(std::floor((x_at(m) + m.rad / 2.0 - GRID_X_OFFSET) / side)), 0, grid_cols - 1); }
+int kinetic_engine::grid_row(const motion &m) const { return std::clamp(int(std::floor((y_at(m) + m.rad / 2.0 - GRID_Y_OFFSET) / side)), 0, grid_rows - 1); }
+void kinetic_engine::link(int n) {
+    motion &m = motions[n];
+    int &head = cell_heads[m.cell_col*grid_rows + m.cell_row];
+    m.cell_prev = -1;
+    m.cell_next = head;
+    if (head != -1) { motions[head].cell_prev = n; }
+    head = n;
+}
+void kinetic_engine::unlink(int n) {
+    motion &m = motions[n];
+    if (m.cell_prev != -1) { motions[m.cell_prev].cell_next = m.cell_next; }
+    else { cell_heads[m.cell_col*grid_rows + m.cell_row] = m.cell_next; }
+    if (m.cell_next != -1) { motions[m.cell_next].cell_prev = m.cell_prev; }
+}
+void kinetic_engine::push(const kinetic_event &e) {
+    // drop stale events in place rather than growing the queue
+    if (queue.size() == queue.capacity()) {
+        std::erase_if(queue, [this](const kinetic_event &pending) { return is_stale(pending); });
+        std::make_heap(queue.begin(), queue.end(), kinetic_later);
+    }
+    queue.emplace_back(e);
+    std::push_heap(queue.begin(), queue.end(), kinetic_later);
+}
+void kinetic_engine::predict_walls(int n) {
+    motion &m = motions[n];
+    ++m.stamp;
+    m.wall_time = std::numeric_limits<double>::infinity();
+
+    // in cells, the box covers [x, x + size) across and [y, y + size) down
+    const double x = (x_at(m) - GRID_X_OFFSET) / GRID_DIM;
+    const double y = (y_at(m) - GRID_Y_OFFSET) / GRID_DIM;
+    const double size = double(m.rad) / GRID_DIM;
+    const double x_speed = m.x_speed / GRID_DIM;
+    const double y_speed = m.y_speed / GRID_DIM;
+
+    // next column and row the leading edges enter, and the time until they do
+    const double never = std::numeric_limits<double>::infinity();
+    int col = 0, row = 0;
+    double x_time = never, y_time = never;
+    if (x_speed > 0) { col = std::ceil(x + size - KINETIC_EPSILON); x_time = std::max(0.0, (col - x - size) / x_speed); }
+    if (x_speed < 0) { col = std::floor(x + KINETIC_EPSILON) - 1; x_time = std::max(0.0, (col + 1 - x) / x_speed); }
+    if (y_speed > 0) { row = std::ceil(y + size - KINETIC_EPSILON); y_time = std::max(0.0, (row - y - size) / y_speed); }
+    if (y_speed < 0) { row = std::floor(y + KINETIC_EPSILON) - 1; y_time = std::max(0.0, (row + 1 - y) / y_speed); }
+
+    // step through the cells entered until one is blocked, the playfield edge always is
+    while (x_time < never || y_time < never) {
+        const double time = std::min(x_time, y_time);
+        const bool cross_x = x_time - time <= KINETIC_TIE;
+        const bool cross_y = y_time - time <= KINETIC_TIE;
+        const double x_now = x + x_speed * time;
+        const double y_now = y + y_speed * time;
+
+        kinetic_event e{now + time, n, -1, m.count, 0, m.stamp, false, false, col, row, col, row};
+        if (cross_x) {
+            const int last = std::ceil(y_now + size - KINETIC_EPSILON);
+            for (int r = std::floor(y_now + KINETIC_EPSILON); r < last && !e.x_axis; ++r) {
+                if (blocked(col, r)) { e.x_axis = true; e.hit_row = r; }
+            }
+        }
+        if (cross_y) {
+            const int last = std::ceil(x_now + size - KINETIC_EPSILON);
+            for (int c = std::floor(x_now + KINETIC_EPSILON); c < last && !e.y_axis; ++c) {
+                if (blocked(c, row)) {
+                    e.y_axis = true;
+                    if (!e.x_axis) { e.hit_col = c; }
+                }
+            }
+        }
+
+        // entering a corner cell alone reflects both ways
+        if (cross_x && cross_y && !e.x_axis && !e.y_axis && blocked(col, row)) { e.x_axis = e.y_axis = true; }
+
+        if (e.x_axis || e.y_axis) {
+            m.wall_time = e.time;
+            push(e);
+            return;
+        }
+        if (cross_x) {
+            col += (x_speed > 0) ? 1 : -1;
+            x_time += 1 / std::abs(x_speed);
+        }
+        if (cross_y) {
+            row += (y_speed > 0) ? 1 : -1;
+            y_time += 1 / std::abs(y_speed);
+        }
+    }
+}
+void kinetic_engine::predict_crossing(int n) {
+    // the cell entered is set from the event, so a centre sitting on a border never crosses back and forth at once
+    const motion &m = motions[n];
+    const double x = x_at(m) + m.rad / 2.0 - GRID_X_OFFSET;
+    const double y = y_at(m) + m.rad / 2.0 - GRID_Y_OFFSET;
+    const double never = std::numeric_limits<double>::infinity();
+    double x_time = never, y_time = never;
+    if (m.x_speed > 0 && m.cell_col + 1 < grid_cols) { x_time = std::max(0.0, ((m.cell_col + 1)*side - x) / m.x_speed); }
+    if (m.x_speed < 0 && m.cell_col > 0) { x_time = std::max(0.0, (m.cell_col*side - x) / m.x_speed); }
+    if (m.y_speed > 0 && m.cell_row + 1 < grid_rows) { y_time = std::max(0.0, ((m.cell_row + 1)*side - y) / m.y_speed); }
+    if (m.y_speed < 0 && m.cell_row > 0) { y_time = std::max(0.0, (m.cell_row*side - y) / m.y_speed); }
+    if (x_time == never && y_time == never) { return; }
+
+    kinetic_event e{now + std::min(x_time, y_time), n, KINETIC_CROSSING, m.count, 0, 0, false, false, m.cell_col, m.cell_row, 0, 0};
+    if (x_time <= y_time) { e.col += (m.x_speed > 0) ? 1 : -1; }
+    else { e.row += (m.y_speed > 0) ? 1 : -1; }
+    push(e);
+}
+double kinetic_engine::pair_time(int n, int other) const {
+    const motion &a = motions[n];
+    const motion &b = motions[other];
+    const double never = std::numeric_limits<double>::infinity();
+
+    // centres close in at a constant rate, solve for when they are a ball apart
+    const double dx = x_at(b) + b.rad / 2.0 - x_at(a) - a.rad / 2.0;
+    const double dy = y_at(b) + b.rad / 2.0 - y_at(a) - a.rad / 2.0;
+    const double dvx = b.x_speed - a.x_speed;
+    const double dvy = b.y_speed - a.y_speed;
+    const double closing = dx*dvx + dy*dvy;
+    if (closing >= 0) { return never; }
+    const double speed = dvx*dvx + dvy*dvy;
+    const double reach = (a.rad + b.rad) / 2.0;
+    const double discriminant = closing*closing - speed * (dx*dx + dy*dy - reach*reach);
+    if (discriminant < 0) { return never; }
+
+    // balls already overlapping and closing in meet at once, a touch after either turns at a wall never happens as predicted
+    const double time = now + std::max(0.0, -(closing + std::sqrt(discriminant)) / speed);
+    return (time > std::min(a.wall_time, b.wall_time)) ? never : time;
+}
+void kinetic_engine::predict_pairs(int n, int skip, bool replace) {
+    motion &m = motions[n];
+    if (replace) {
+        ++m.pair_stamp;
+        m.pair_time = std::numeric_limits<double>::infinity();
+    }
+
+    // the balls in the 3x3 neighbour cells around the centre
+    double earliest = std::numeric_limits<double>::infinity();
+    int partner = -1;
+    for (int col = std::max(m.cell_col - 1, 0); col <= std::min(m.cell_col + 1, grid_cols - 1); ++col) {
+        for (int row = std::max(m.cell_row - 1, 0); row <= std::min(m.cell_row + 1, grid_rows - 1); ++row) {
+            for (int other = cell_heads[col*grid_rows + row]; other != -1; other = motions[other].cell_next) {
+                if (other == n || other == skip) { continue; }
+                const double time = pair_time(n, other);
+                if (time < earliest) {
+                    earliest = time;
+                    partner = other;
+                }
+            }
+        }
+    }
+
+    // only the earliest touch is queued, later ones are found again once it has come up
+    if (partner < 0 || earliest >= m.pair_time) { return; }
+    ++m.pair_stamp;
+    m.pair_time = earliest;
+    push(kinetic_event{earliest, n, partner, m.count, motions[partner].count, m.pair_stamp, false, false, 0, 0, 0, 0});
+}
+void kinetic_engine::predict(int n, int skip) {
+    predict_walls(n);
+    predict_crossing(n);
+    predict_pairs(n, skip, true);
+}
+void kinetic_engine::rebuild(const std::vector<wall> &walls_list, const std::vector<ball> &balls_list) {
+    // room for the most balls the list has, so later levels do not allocate
+    const std::size_t most = std::max(balls_list.size(), balls_list.capacity());
+    if (motions.capacity() < most) {
+        motions.reserve(most);
+        queue.reserve(KINETIC_QUEUE_ROOM * KINETIC_LIVE_EVENTS * most);
+    }
+
+    const std::size_t cells = std::size_t(cols) * rows;
+    if (built.size() != cells) { built.assign(cells, 0); }
+    std::fill(built.begin(), built.end(), 0);
+    for (const wall &w : walls_list) { built[((w.hitbox.x - GRID_X_OFFSET) / GRID_DIM) * rows + (w.hitbox.y - GRID_Y_OFFSET) / GRID_DIM] = 1; }
+    synced = walls_list.size();
+
+    // neighbour cells at least as wide as the largest ball
+    int widest = 0;
+    for (const ball &b : balls_list) { widest = std::max(widest, b.rad); }
+    side = std::max(GRID_DIM, widest + 1);
+    grid_cols = (cols*GRID_DIM + side - 1) / side;
+    grid_rows = (rows*GRID_DIM + side - 1) / side;
+    cell_heads.assign(std::size_t(grid_cols) * grid_rows, -1);
+
+    now = 0;
+    motions.clear();
+    for (const ball &b : balls_list) {
+        motion m{b.x_pos, b.y_pos, 0, b.x_speed, b.y_speed, b.rad, 0, 0, 0, 0, 0, 0, 0, -1, -1, b.x_pos, b.y_pos, b.x_speed, b.y_speed};
+        m.cell_col = grid_col(m);
+        m.cell_row = grid_row(m);
+        motions.emplace_back(m);
+        link(int(motions.size()) - 1);
+    }
+
+    // every ball against the walls first, touches are only predicted up to the walls of both balls
+    queue.clear();
+    for (int n = 0; n < int(motions.size()); ++n) {
+        predict_walls(n);
+        predict_crossing(n);
+    }
+    for (int n = 0; n < int(motions.size()); ++n) { predict_pairs(n, -1, true); }
+}
+void kinetic_engine::add_walls(const std::vector<wall> &walls_list) {
+    for (; synced < walls_list.size(); ++synced) {
+        const SDL_Rect &w = walls_list[synced].hitbox;
+        const int col = (w.x - GRID_X_OFFSET) / GRID_DIM;
+        const int row = (w.y - GRID_Y_OFFSET) / GRID_DIM;
+        built[col*rows + row] = 1;
+
+        for (int n = 0; n < int(motions.size()); ++n) {
+            motion &m = motions[n];
+            const double x = x_at(m);
+            const double y = y_at(m);
+
+            // built over the ball, send it away from the cell along the axis it is furthest out on, as handle_wall_collisions does
+            if (x < w.x + w.w && x + m.rad > w.x && y < w.y + w.h && y + m.rad > w.y) {
+                const double dx = (x + m.rad / 2.0) - (w.x + w.w / 2.0);
+                const double dy = (y + m.rad / 2.0) - (w.y + w.h / 2.0);
+                settle(m);
+                if (std::abs(dx) > std::abs(dy)) {
+                    if ((dx >= 0) != (m.x_speed >= 0)) { m.x_speed = -m.x_speed; }
+                } else {
+                    if ((dy >= 0) != (m.y_speed >= 0)) { m.y_speed = -m.y_speed; }
+                }
+                ++m.count;
+                predict(n, -1);
+                continue;
+            }
+
+            // the cell is within the box swept up to the predicted wall, which may no longer be the first
+            const double span = std::min(m.wall_time - now, 1e9);
+            const double x_end = x + m.x_speed * span;
+            const double y_end = y + m.y_speed * span;
+            if (std::min(x, x_end) < w.x + w.w && std::max(x, x_end) + m.rad > w.x && std::min(y, y_end) < w.y + w.h && std::max(y, y_end) + m.rad > w.y) {
+                predict_walls(n);
+            }
+        }
+    }
+}
+bool kinetic_engine::moved_elsewhere(const std::vector<ball> &balls_list) const {
+    if (balls_list.size() != motions.size()) { return true; }
+    for (std::size_t n = 0; n < motions.size(); ++n) {
+        const ball &b = balls_list[n];
+        const motion &m = motions[n];
+        if (b.x_pos != m.x_written || b.y_pos != m.y_written || b.x_speed != m.x_speed_written || b.y_speed != m.y_speed_written) { return true; }
+    }
+    return false;
+}
+void kinetic_engine::advance(double time, std::vector<ball> &balls_list) {
+    while (!queue.empty() && queue.front().time <= time) {
+        std::pop_heap(queue.begin(), queue.end(), kinetic_later);
+        const kinetic_event e = queue.back();
+        queue.pop_back();
+        if (is_stale(e)) { continue; }
+        stats.add(KINETIC_EVENTS, 1);
+        now = e.time;
+
+        motion &a = motions[e.ball];
+        if (e.other == KINETIC_CROSSING) {
+            // into the list of the cell entered, and against the balls that are now around it
+            unlink(e.ball);
+            a.cell_col = e.col;
+            a.cell_row = e.row;
+            link(e.ball);
+            predict_crossing(e.ball);
+            predict_pairs(e.ball, -1, false);
+            continue;
+        }
+        if (e.other >= 0 && motions[e.other].count != e.other_count) {
+            // the other ball turned first, look for the next touch instead
+            predict_pairs(e.ball, -1, true);
+            continue;
+        }
+
+        settle(a);
+        if (e.other < 0) {
+            // against the cell face entered, exactly, so the box does not cover the cell afterwards
+            if (e.x_axis) {
+                a.x = (a.x_speed > 0) ? GRID_X_OFFSET + e.col*GRID_DIM - a.rad : GRID_X_OFFSET + (e.col + 1)*GRID_DIM;
+                a.x_speed = -a.x_speed;
+            }
+            if (e.y_axis) {
+                a.y = (a.y_speed > 0) ? GRID_Y_OFFSET + e.row*GRID_DIM - a.rad : GRID_Y_OFFSET + (e.row + 1)*GRID_DIM;
+                a.y_speed = -a.y_speed;
+            }
+            ++a.count;
+
+            // walls touched are checked against the walls being built
+            ball &b = balls_list[e.ball];
+            if (e.hit_col >= 0 && e.hit_col < cols && e.hit_row >= 0 && e.hit_row < rows && b.contact_count < ball::MAX_CONTACTS) {
+                b.contacts[b.contact_count++] = SDL_Rect{Sint16(GRID_X_OFFSET + e.hit_col*GRID_DIM), Sint16(GRID_Y_OFFSET + e.hit_row*GRID_DIM), Uint16(GRID_DIM), Uint16(GRID_DIM)};
+            }
+            predict(e.ball, -1);
+        } else {
+            // swap the speeds on each axis the balls close in on, which always parts them
+            motion &b = motions[e.other];
+            settle(b);
+            const double dx = (b.x + b.rad / 2.0) - (a.x + a.rad / 2.0);
+            const double dy = (b.y + b.rad / 2.0) - (a.y + a.rad / 2.0);
+            if ((b.x_speed - a.x_speed) * dx < 0) { std::swap(a.x_speed, b.x_speed); }
+            if ((b.y_speed - a.y_speed) * dy < 0) { std::swap(a.y_speed, b.y_speed); }
+            ++a.count;
+            ++b.count;
+            predict(e.ball, e.other);
+            predict(e.other, e.ball);
+        }
+    }
+    now = time;
+}
+void kinetic_engine::tick(const std::vector<wall> &walls_list, std::vector<ball> &balls_list, int dt_ms) {
+    trace_zone zone("kinetic_tick");
+
+    // walls are only appended until a level is reset, balls only move here unless the level, a scenario or a rewind replaced them
+    if (walls_list.size() < synced || moved_elsewhere(balls_list)) { rebuild(walls_list, balls_list); }
+    else { add_walls(walls_list); }
+
+    advance(now + KINETIC_PACE * dt_ms / 1000.0, balls_list);
+
+    // where each ball is at the end of the tick
+    for (std::size_t n = 0; n < motions.size(); ++n) {
+        motion &m = motions[n];
+        ball &b = balls_list[n];
+        b.x_pos = x_at(m);
+        b.y_pos = y_at(m);
+        b.x_speed = m.x_speed;
+        b.y_speed = m.y_speed;
+        b.shift_boxes();
+        m.x_written = b.x_pos;
+        m.y_written = b.y_pos;
+        m.x_speed_written = b.x_speed;
+        m.y_speed_written = b.y_speed;
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "SDL/SDL.h"
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+// ticks simulated by each rollout of the fork benchmark, one second of play
+const unsigned int BENCHMARK_ROLLOUT_TICKS = FPS_CAP;
+
+struct rollout_result {
+    // ticks simulated before the rollout stopped
+    unsigned int ticks = 0;
+
+    unsigned int lives_lost = 0;
+    bool level_complete = false;
+    float percentage = 0;
+};
+
+void fork_simulation(const simulation &source, simulation &target) {
+    // copy assignment reuses the target's storage, so forking into the same target again does not allocate
+    target = source;
+}
+
+bool place_wall(simulation &sim, int col, int row, orientation wall_orientation) {
+    // place a wall at a cell the way a left click does, returns false if nothing was placed
+    if ((col < 0) || (row < 0) || (col >= int(sim.grid.size())) || (row >= int(sim.grid[0].size()))) { return false; }
+    if (!sim.walls_to_build_black.empty() || !sim.walls_to_build_white.empty()) { return false; }
+    sim.grid[col][row].handle(sim.grid, sim.walls_list, sim.occupancy, sim.walls_to_build_black, sim.walls_to_build_white, wall_orientation, sim.build_timer.get_ticks());
+    return !sim.walls_to_build_black.empty() || !sim.walls_to_build_white.empty();
+}
+
+void tick_simulation(const options &parameters, simulation &sim) {
+    // one tick of gameplay, same order as the game loop
+    build_walls(parameters, sim.build_timer, sim.grid, sim.walls_list, sim.walls_to_build_black, sim.walls_black_buffer, sim.walls_black_building);
+    build_walls(parameters, sim.build_timer, sim.grid, sim.walls_list, sim.walls_to_build_white, sim.walls_white_buffer, sim.walls_white_building);
+    ball_handle(sim.game_state, sim.balls_list, sim.ball_timer, sim.walls_list, sim.walls_to_build_black, sim.walls_to_build_white, sim.walls_black_buffer, sim.walls_white_buffer, sim.regions, sim.kinetic);
+    fill_handle(sim.game_state, sim.grid, sim.walls_list, sim.walls_black_building, sim.walls_white_building, sim.balls_list, sim.fill);
+}
+
+rollout_result rollout(const options &parameters, simulation &sim, unsigned int ticks, unsigned int tick_ms) {
+    trace_zone zone("rollout");
+    rollout_result result;
+
+    // pin the clock where the fork was taken and step it per tick, the caller's clock is restored afterwards
+    const bool saved_fixed = clock_fixed;
+    const Uint32 saved_ticks = clock_fixed_ticks;
+    clock_fixed_ticks = clock_ticks();
+    clock_fixed = true;
+
+    const unsigned int starting_lives = sim.game_state.current_lives;
+    while (result.ticks < ticks) {
+        clock_fixed_ticks += tick_ms;
+        ++result.ticks;
+
+        tick_simulation(parameters, sim);
+
+        // stop where the game would leave the level
+        if (sim.game_state.current_percentage > parameters.PERCENTAGE_TARGET) {
+            result.level_complete = true;
+            break;
+        }
+        if (sim.game_state.current_lives <= 0) { break; }
+    }
+
+    clock_fixed = saved_fixed;
+    clock_fixed_ticks = saved_ticks;
+
+    result.lives_lost = starting_lives - sim.game_state.current_lives;
+    result.percentage = sim.game_state.current_percentage;
+    return result;
+}
+
+void fork_benchmark(const options &parameters, const simulation &sim, unsigned int rollouts) {
+    simulation fork;
+
+    // forks alone
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int n = 0; n < rollouts; ++n) { fork_simulation(sim, fork); }
+    const double fork_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // fork, place a random wall, play it out
+    unsigned long total_ticks = 0;
+    start = std::chrono::steady_clock::now();
+    for (unsigned int n = 0; n < rollouts; ++n) {
+        fork_simulation(sim, fork);
+        // start from a fresh tick rather than the time since the benchmark began
+        fork.ball_timer.start();
+        place_wall(fork, std::rand() % fork.grid.size(), std::rand() % fork.grid[0].size(), (std::rand() % 2) ? orientation::vertical : orientation::horizontal);
+        total_ticks += rollout(parameters, fork, BENCHMARK_ROLLOUT_TICKS, 1000 / FPS_CAP).ticks;
+    }
+    const double rollout_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "forks: " << rollouts << ", balls: " << sim.balls_list.size() << ", walls: " << sim.walls_list.size() << std::endl;
+    std::cout << "forks per second: " << rollouts / fork_seconds << std::endl;
+    std::cout << "rollouts per second: " << rollouts / rollout_seconds << std::endl;
+    std::cout << "rollout ticks per second: " << total_ticks / rollout_seconds << std::endl;
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include "SDL/SDL.h"
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+
+// INDEXED RENDERING
+// -indexed composites frames at 8 bits per pixel, a quarter of the bytes a 32 bit frame moves per blit, fill and scale
+// the artwork is converted once on loading to a palette of its own colours, and frames are only expanded to the window's format when presented
+
+// colours drawn that are not in the artwork: black clears frames, white is the colour key and yellow is the stats text
+const std::array<SDL_Color, 3> PALETTE_RESERVED = {{{0, 0, 0, 0}, {255, 255, 255, 0}, {255, 255, 0, 0}}};
+
+class indexed_palette {
+    // one palette shared by the frame and everything drawn into it
+    private:
+        // pixels of each colour in the artwork, by 0xrrggbb
+        std::unordered_map<Uint32, unsigned long> counts;
+
+        std::vector<SDL_Color> colours;
+
+        // entry of each colour in the palette, colours left out map to the nearest entry
+        std::unordered_map<Uint32, Uint8> entries;
+
+        // colour of a pixel as 0xrrggbb, in any pixel format
+        static Uint32 read_rgb(const SDL_Surface* surface, int x, int y);
+
+        Uint8 nearest(Uint32 rgb) const;
+
+    public:
+        // count the colours of an image, before the palette is built
+        void add(SDL_Surface* image);
+
+        // reserved colours first, then the most used colours of the artwork up to 256 entries
+        void build();
+
+        // give an 8 bit surface the palette
+        void apply(SDL_Surface* surface) const;
+
+        // 8 bit surface with the palette, cleared to black
+        SDL_Surface* create(int width, int height) const;
+
+        // 8 bit copy of image in the palette
+        SDL_Surface* convert(SDL_Surface* image);
+};
+
+indexed_palette screen_palette;
+
+// INDEXED PALETTE CLASS
+Uint32 indexed_palette::read_rgb(const SDL_Surface* surface, int x, int y) {
+    const int bytes = surface->format->BytesPerPixel;
+    const Uint8* p = static_cast<const Uint8*>(surface->pixels) + y*surface->pitch + x*bytes;
+    Uint32 pixel;
+    switch (bytes) {
+        case 1: pixel = *p; break;
+        case 2: pixel = *reinterpret_cast<const Uint16*>(p); break;
+        case 4: pixel = *reinterpret_cast<const Uint32*>(p); break;
+        default: pixel = p[0] | (p[1] << 8) | (p[2] << 16); break;
+    }
+    Uint8 r, g, b;
+    SDL_GetRGB(pixel, surface->format, &r, &g, &b);
+    return Uint32(r) << 16 | Uint32(g) << 8 | b;
+}
+Uint8 indexed_palette::nearest(Uint32 rgb) const {
+    // closest entry by squared distance
+    const int r = (rgb >> 16) & 0xff, g = (rgb >> 8) & 0xff, b = rgb & 0xff;
+    int best = 0;
+    long closest = -1;
+    for (std::size_t n = 0; n < colours.size(); ++n) {
+        const long dr = colours[n].r - r, dg = colours[n].g - g, db = colours[n].b - b;
+        const long distance = dr*dr + dg*dg + db*db;
+        if (closest < 0 || distance < closest) {
+            closest = distance;
+            best = int(n);
+        }
+    }
+    return Uint8(best);
+}
+void indexed_palette::add(SDL_Surface* image) {
+    SDL_LockSurface(image);
+    for (int y = 0; y < image->h; ++y) {
+        for (int x = 0; x < image->w; ++x) { ++counts[read_rgb(image, x, y)]; }
+    }
+    SDL_UnlockSurface(image);
+}
+void indexed_palette::build() {
+    colours.clear();
+    entries.clear();
+    for (const SDL_Color &c : PALETTE_RESERVED) {
+        entries[Uint32(c.r) << 16 | Uint32(c.g) << 8 | c.b] = Uint8(colours.size());
+        colours.push_back(c);
+    }
+
+    // most used first, ties by colour so the palette does not depend on hash order
+    std::vector<std::pair<Uint32, unsigned long>> ranked(counts.begin(), counts.end());
+    std::sort(ranked.begin(), ranked.end(), [](const auto &a, const auto &b) { return (a.second != b.second) ? a.second > b.second : a.first < b.first; });
+    for (const auto &[rgb, count] : ranked) {
+        if (colours.size() == 256) { break; }
+        if (entries.count(rgb)) { continue; }
+        entries[rgb] = Uint8(colours.size());
+        colours.push_back(SDL_Color{Uint8(rgb >> 16), Uint8(rgb >> 8), Uint8(rgb), 0});
+    }
+    counts.clear();
+}
+void indexed_palette::apply(SDL_Surface* surface) const { SDL_SetColors(surface, const_cast<SDL_Color*>(colours.data()), 0, int(colours.size())); }
+SDL_Surface* indexed_palette::create(int width, int height) const {
+    SDL_Surface* surface = SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, 8, 0, 0, 0, 0);
+    if (surface == NULL) { return NULL; }
+    apply(surface);
+    SDL_FillRect(surface, NULL, 0);
+    return surface;
+}
+SDL_Surface* indexed_palette::convert(SDL_Surface* image) {
+    SDL_Surface* indexed = create(image->w, image->h);
+    if (indexed == NULL) { return NULL; }
+    SDL_LockSurface(image);
+    SDL_LockSurface(indexed);
+    for (int y = 0; y < image->h; ++y) {
+        Uint8* row = static_cast<Uint8*>(indexed->pixels) + y*indexed->pitch;
+        for (int x = 0; x < image->w; ++x) {
+            // colours left out of the palette are matched once and remembered
+            const Uint32 rgb = read_rgb(image, x, y);
+            auto entry = entries.find(rgb);
+            if (entry == entries.end()) { entry = entries.emplace(rgb, nearest(rgb)).first; }
+            row[x] = entry->second;
+        }
+    }
+    SDL_UnlockSurface(indexed);
+    SDL_UnlockSurface(image);
+    return indexed;
+}
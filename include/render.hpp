@@ -0,0 +1,420 @@
+#pragma once
+#include "SDL/SDL.h"
+#include <vector>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdint>
+
+enum class overlay : unsigned char {
+    none,
+    pause,
+    level_complete,
+    game_over,
+    game_over_animation,
+    game_winner,
+    game_winner_animation,
+};
+
+struct snapshot {
+    // ball positions in pixels
+    std::vector<std::pair<int, int>> balls;
+
+    // placed walls
+    std::vector<wall> walls;
+
+    // view the playfield is drawn with, when zoomed walls and balls are also indexed by cell, col * rows + row
+    camera_view view;
+    std::vector<unsigned char> cells;
+    std::vector<std::uint32_t> cell_balls;
+    std::vector<std::uint32_t> ball_order;
+
+    // hud values
+    unsigned int level = 0;
+    unsigned int lives = 0;
+    unsigned int percentage = 0;
+
+    // image drawn over the playfield
+    overlay screen_overlay = overlay::none;
+
+    // engine counters of the previous frame
+    bool show_stats = false;
+    counter_sample counters{};
+};
+
+class renderer {
+    // triple buffered snapshots, the simulation writes to back while the render thread reads from front
+    private:
+        snapshot frames[3];
+        int back_index;
+        int ready_index;
+        int front_index;
+
+        // ready frame has not been rendered yet
+        bool fresh;
+
+        bool running;
+        bool failed;
+
+        // receives every composited frame when exporting
+        frame_encoder* encoder;
+
+        std::mutex frames_mutex;
+        std::condition_variable frames_ready;
+        std::thread render_worker;
+
+        // render thread body
+        void render_loop();
+
+    public:
+        renderer();
+
+        // launch and join render thread
+        void start();
+        void stop();
+
+        // hand composited frames to an encoder
+        void record(frame_encoder* frame_export);
+
+        // size every frame for the given number of walls and balls, before the render thread starts
+        void reserve(std::size_t walls, std::size_t balls);
+
+        // frame currently owned by the simulation
+        snapshot &back();
+
+        // render back frame inline, or hand it to the render thread
+        bool present();
+
+        bool is_running() const;
+};
+
+// RENDERING
+void render_digits(unsigned int number, int digit_1_offset, int digit_2_offset, bool invert) {
+    // split number 0-99 into two digits
+    if (number > 99) { return; }
+    const int digit_1 = number / 10;
+    const int digit_2 = number % 10;
+
+    if (digit_1 == 0) {
+        if (!invert) {
+            // digit 1 = digit 2
+            apply_surface(digit_1_offset, 0, digits_surface, screen, &digits_clip[digit_2]);
+        } else {
+            apply_surface(digit_2_offset, 0, digits_surface, screen, &digits_clip[digit_2]);
+        }
+    } else {
+        apply_surface(digit_1_offset, 0, digits_surface, screen, &digits_clip[digit_1]);
+        apply_surface(digit_2_offset, 0, digits_surface, screen, &digits_clip[digit_2]);
+    }
+}
+
+void hud_handle(const snapshot &frame) {
+    // render level, lives, captured percentage
+    render_digits(frame.level, LEVEL_DIGIT_1_OFFSET, LEVEL_DIGIT_2_OFFSET, false);
+    render_digits(frame.lives, LIVES_DIGIT_1_OFFSET, LIVES_DIGIT_2_OFFSET, false);
+    render_digits(frame.percentage, PERCENTAGE_DIGIT_1_OFFSET, PERCENTAGE_DIGIT_2_OFFSET, true);
+}
+
+void wall_handle(std::vector<wall> &walls_list) {
+    trace_zone zone("wall_handle");
+    stats.add(WALLS_BLITTED, walls_list.size());
+
+    // for each wall placed
+    for (wall &current_wall : walls_list) {
+        // render wall
+        if (current_wall.colour) {
+            SDL_BlitSurface(wall_black, NULL, screen, &current_wall.hitbox);
+        } else {
+            SDL_BlitSurface(wall_white, NULL, screen, &current_wall.hitbox);
+        }
+    }
+}
+
+// 3x5 glyphs, one bit per pixel from the top left, read row by row
+const unsigned short font_digits[10] = {0x7b6f, 0x2c97, 0x73e7, 0x73cf, 0x5bc9, 0x79cf, 0x79ef, 0x7249, 0x7bef, 0x7bcf};
+const unsigned short font_letters[26] = {0x2bed, 0x6bae, 0x3923, 0x6b6e, 0x79a7, 0x79a4, 0x396b, 0x5bed, 0x7497, 0x126a, 0x5bad, 0x4927, 0x5fed, 0x6b6d, 0x2b6a, 0x6ba4, 0x2b73, 0x6bad, 0x388e, 0x7492, 0x5b6f, 0x5b6a, 0x5bfd, 0x5aad, 0x5a92, 0x72a7};
+const int FONT_SCALE = 2;
+
+void render_text(int x, int y, const char* text, Uint32 colour) {
+    // draw text in the built in font, unknown characters are left blank
+    for (; *text != '\0'; ++text, x += 4*FONT_SCALE) {
+        unsigned short glyph = 0;
+        if (*text >= '0' && *text <= '9') { glyph = font_digits[*text - '0']; }
+        else if (*text >= 'A' && *text <= 'Z') { glyph = font_letters[*text - 'A']; }
+        for (int pixel = 0; pixel < 15; ++pixel) {
+            if (glyph & (1 << (14 - pixel))) {
+                SDL_Rect dot;
+                dot.x = x + (pixel % 3)*FONT_SCALE;
+                dot.y = y + (pixel / 3)*FONT_SCALE;
+                dot.w = FONT_SCALE;
+                dot.h = FONT_SCALE;
+                SDL_FillRect(screen, &dot, colour);
+            }
+        }
+    }
+}
+
+void stats_overlay_handle(const snapshot &frame) {
+    // list counters of the previous frame in two columns below the playfield
+    const int line_height = 6*FONT_SCALE;
+    const int rows = (COUNTER_COUNT + 1) / 2;
+    const int column_width = (SCREEN_WIDTH - 2*GRID_X_OFFSET) / 2;
+    char line[64];
+    for (int c = 0; c < COUNTER_COUNT; ++c) {
+        std::snprintf(line, sizeof(line), "%-15s %lu", counter_labels[c], frame.counters[c]);
+        render_text(GRID_X_OFFSET + (c / rows)*column_width, SCREEN_HEIGHT - (rows - c % rows)*line_height, line, SDL_MapRGB(screen->format, 255, 255, 0));
+    }
+}
+
+int playfield_cell(int x, int y) {
+    // cell holding a screen point of the unzoomed playfield, points off it count as the nearest cell
+    const int col = std::clamp((x - GRID_X_OFFSET) / GRID_DIM, 0, PLAYFIELD_COLS - 1);
+    const int row = std::clamp((y - GRID_Y_OFFSET) / GRID_DIM, 0, PLAYFIELD_ROWS - 1);
+    return col * PLAYFIELD_ROWS + row;
+}
+
+void index_snapshot(snapshot &frame) {
+    // sort walls and balls by cell, so a zoomed view looks up only the cells it shows
+    if (frame.view.zoom == 1) { return; }
+    trace_zone zone("index_snapshot");
+    const std::size_t cells = PLAYFIELD_COLS * PLAYFIELD_ROWS;
+
+    frame.cells.assign(cells, CELL_OPEN);
+    for (const wall &w : frame.walls) { frame.cells[playfield_cell(w.hitbox.x, w.hitbox.y)] = w.colour ? CELL_BLACK : CELL_WHITE; }
+
+    // counting sort, cell_balls[c] is where the balls of cell c start in ball_order and cell_balls[c + 1] where they end
+    frame.cell_balls.assign(cells + 1, 0);
+    for (const std::pair<int, int> &position : frame.balls) { ++frame.cell_balls[playfield_cell(position.first, position.second) + 1]; }
+    for (std::size_t c = 1; c <= cells; ++c) { frame.cell_balls[c] += frame.cell_balls[c - 1]; }
+    frame.ball_order.resize(frame.balls.size());
+    for (std::size_t n = 0; n < frame.balls.size(); ++n) {
+        frame.ball_order[frame.cell_balls[playfield_cell(frame.balls[n].first, frame.balls[n].second)]++] = n;
+    }
+    // each start was moved up to the next start while filling
+    for (std::size_t c = cells; c > 0; --c) { frame.cell_balls[c] = frame.cell_balls[c - 1]; }
+    frame.cell_balls[0] = 0;
+}
+
+void zoomed_playfield_handle(const snapshot &frame) {
+    // draw only the cells in view, and the balls starting in them or in the cell before, which can reach into view
+    trace_zone zone("zoomed_playfield");
+    const camera_view &view = frame.view;
+    SDL_Rect playfield = {GRID_X_OFFSET, GRID_Y_OFFSET, PLAYFIELD_WIDTH, PLAYFIELD_HEIGHT};
+    SDL_SetClipRect(screen, &playfield);
+
+    const int first_col = view.x / GRID_DIM;
+    const int last_col = std::min(PLAYFIELD_COLS - 1, (view.x + PLAYFIELD_WIDTH / view.zoom) / GRID_DIM);
+    const int first_row = view.y / GRID_DIM;
+    const int last_row = std::min(PLAYFIELD_ROWS - 1, (view.y + PLAYFIELD_HEIGHT / view.zoom) / GRID_DIM);
+    auto screen_x = [&](int x) { return GRID_X_OFFSET + (x - GRID_X_OFFSET - view.x) * view.zoom; };
+    auto screen_y = [&](int y) { return GRID_Y_OFFSET + (y - GRID_Y_OFFSET - view.y) * view.zoom; };
+
+    // cells and walls
+    unsigned long walls = 0;
+    for (int col = first_col; col <= last_col; ++col) {
+        for (int row = first_row; row <= last_row; ++row) {
+            const unsigned char contents = frame.cells[col * PLAYFIELD_ROWS + row];
+            SDL_Surface* sprite = (contents == CELL_OPEN) ? screen_camera.cell_sprite(view.zoom) : screen_camera.wall_sprite(view.zoom, contents == CELL_BLACK);
+            SDL_Rect at;
+            at.x = screen_x(GRID_X_OFFSET + col * GRID_DIM);
+            at.y = screen_y(GRID_Y_OFFSET + row * GRID_DIM);
+            SDL_BlitSurface(sprite, NULL, screen, &at);
+            walls += (contents != CELL_OPEN);
+        }
+    }
+    stats.add(WALLS_BLITTED, walls);
+
+    // balls
+    SDL_Surface* ball_sprite = screen_camera.ball_sprite(view.zoom);
+    for (int col = std::max(0, first_col - 1); col <= last_col; ++col) {
+        const int cell = col * PLAYFIELD_ROWS;
+        for (std::uint32_t n = frame.cell_balls[cell + std::max(0, first_row - 1)]; n < frame.cell_balls[cell + last_row + 1]; ++n) {
+            const std::pair<int, int> &position = frame.balls[frame.ball_order[n]];
+            apply_surface(screen_x(position.first), screen_y(position.second), ball_sprite, screen);
+        }
+    }
+
+    SDL_SetClipRect(screen, NULL);
+}
+
+void snapshot_reserve(snapshot &frame, std::size_t walls, std::size_t balls) {
+    // size a frame for the given number of walls and balls
+    frame.walls.reserve(walls);
+    frame.balls.reserve(balls);
+    frame.cells.reserve(PLAYFIELD_COLS * PLAYFIELD_ROWS);
+    frame.cell_balls.reserve(PLAYFIELD_COLS * PLAYFIELD_ROWS + 1);
+    frame.ball_order.reserve(balls);
+}
+
+void overlay_handle(SDL_Surface* overlay_surface) {
+    // center overlay on screen
+    apply_surface((SCREEN_WIDTH-overlay_surface->w)/2, (SCREEN_HEIGHT-overlay_surface->h)/2, overlay_surface, screen);
+}
+
+void capture_snapshot(snapshot &frame, const state &game_state, const std::vector<wall> &walls_list, const std::vector<ball> &balls_list, overlay screen_overlay) {
+    trace_zone zone("capture_snapshot");
+
+    // copy into existing storage so steady state frames reuse capacity
+    frame.balls.resize(balls_list.size());
+    for (std::vector<ball>::size_type n = 0; n < balls_list.size(); ++n) {
+        frame.balls[n].first = balls_list[n].x_pos;
+        frame.balls[n].second = balls_list[n].y_pos;
+    }
+    frame.walls.assign(walls_list.begin(), walls_list.end());
+    frame.view = screen_camera.view();
+    index_snapshot(frame);
+    frame.level = game_state.current_level;
+    frame.lives = game_state.current_lives;
+    frame.percentage = game_state.current_percentage;
+    frame.screen_overlay = screen_overlay;
+    frame.show_stats = game_state.show_stats;
+    frame.counters = stats.last_frame();
+}
+
+bool composite_frame(snapshot &frame) {
+    // draw the frame into screen, render_frame then presents it
+
+    // clear frame
+    if (SDL_FillRect(screen, NULL, 0x000000) == -1) { return false; }
+    if (SDL_BlitSurface(background_surface, NULL, screen, NULL) == -1) { return false; }
+
+    // hud is drawn over endgame overlays, everything else is drawn under
+    switch (frame.screen_overlay) {
+        case overlay::none:
+        case overlay::pause:
+        case overlay::level_complete:
+            hud_handle(frame);
+            break;
+        default:
+            break;
+    }
+
+    // render walls and balls, through the camera when zoomed
+    if (frame.view.zoom > 1) {
+        zoomed_playfield_handle(frame);
+    } else {
+        wall_handle(frame.walls);
+        for (std::pair<int, int> &position : frame.balls) {
+            apply_surface(position.first, position.second, balls_surface, screen);
+        }
+    }
+
+    // render overlay
+    switch (frame.screen_overlay) {
+        case overlay::none:
+            break;
+        case overlay::pause:
+            overlay_handle(pause_surface);
+            break;
+        case overlay::level_complete:
+            overlay_handle(level_complete_surface);
+            break;
+        case overlay::game_over:
+            overlay_handle(game_over_surface);
+            hud_handle(frame);
+            break;
+        case overlay::game_winner:
+            overlay_handle(game_winner_surface);
+            hud_handle(frame);
+            break;
+        case overlay::game_over_animation:
+            overlay_handle(game_over_animation_surface);
+            // flash lives
+            render_digits(frame.level, LEVEL_DIGIT_1_OFFSET, LEVEL_DIGIT_2_OFFSET, false);
+            render_digits(frame.percentage, PERCENTAGE_DIGIT_1_OFFSET, PERCENTAGE_DIGIT_2_OFFSET, true);
+            break;
+        case overlay::game_winner_animation:
+            overlay_handle(game_winner_animation_surface);
+            // flash level
+            render_digits(frame.lives, LIVES_DIGIT_1_OFFSET, LIVES_DIGIT_2_OFFSET, false);
+            render_digits(frame.percentage, PERCENTAGE_DIGIT_1_OFFSET, PERCENTAGE_DIGIT_2_OFFSET, true);
+            break;
+    }
+
+    // render engine counters
+    if (frame.show_stats) { stats_overlay_handle(frame); }
+    return true;
+}
+
+bool render_frame(snapshot &frame, frame_encoder* encoder) {
+    trace_zone zone("render_frame");
+    if (!composite_frame(frame)) { return false; }
+
+    // export
+    if (encoder != NULL && !encoder->push(screen)) { return false; }
+
+    // scale or expand into the window
+    if (screen != window_surface) {
+        trace_zone scale_zone("scale");
+        if (!screen_scaler.present(screen, window_surface)) { return false; }
+    }
+
+    // present
+    trace_zone flip_zone("SDL_Flip");
+    return SDL_Flip(window_surface) != -1;
+}
+
+// RENDERER CLASS
+renderer::renderer() {
+    back_index = 0;
+    ready_index = 1;
+    front_index = 2;
+    fresh = false;
+    running = false;
+    failed = false;
+    encoder = NULL;
+}
+void renderer::start() {
+    if (running) { return; }
+    running = true;
+    render_worker = std::thread(&renderer::render_loop, this);
+}
+void renderer::stop() {
+    if (!running) { return; }
+    {
+        std::lock_guard<std::mutex> lock(frames_mutex);
+        running = false;
+    }
+    frames_ready.notify_one();
+    render_worker.join();
+}
+void renderer::render_loop() {
+    while (true) {
+        {
+            // wait for a new frame, then take it
+            std::unique_lock<std::mutex> lock(frames_mutex);
+            frames_ready.wait(lock, [this]{ return fresh || !running; });
+            if (!running) { return; }
+            std::swap(front_index, ready_index);
+            fresh = false;
+        }
+        // composite and flip without holding the lock
+        if (!render_frame(frames[front_index], encoder)) {
+            std::lock_guard<std::mutex> lock(frames_mutex);
+            failed = true;
+            return;
+        }
+    }
+}
+void renderer::record(frame_encoder* frame_export) { encoder = frame_export; }
+void renderer::reserve(std::size_t walls, std::size_t balls) {
+    for (snapshot &frame : frames) { snapshot_reserve(frame, walls, balls); }
+}
+snapshot &renderer::back() { return frames[back_index]; }
+bool renderer::present() {
+    // render on the calling thread
+    if (!running) { return render_frame(frames[back_index], encoder); }
+
+    // publish back frame, replacing any frame the render thread has not picked up yet
+    {
+        std::lock_guard<std::mutex> lock(frames_mutex);
+        if (failed) { return false; }
+        std::swap(back_index, ready_index);
+        fresh = true;
+    }
+    frames_ready.notify_one();
+    return true;
+}
+bool renderer::is_running() const { return running; }
@@ -0,0 +1,412 @@
+#pragma once
+#include "SDL/SDL.h"
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+// REWIND
+// every gameplay tick is kept in a fixed size byte ring, as a keyframe or as a delta from the tick before
+//     keyframe    'K' bytes(u32) level lives percentage balls(u32) walls(u16) then per ball x y x_speed y_speed (fixed) then per wall cell(u16)
+//     delta       'D' bytes(u32) lives percentage tick_ms(u8) new_walls(u16) then per new wall cell(u16), ball codes, escaped axes
+// balls are predicted to carry on at their speed for tick_ms, a ball's code holds a bit per axis set when the prediction
+// lands on another pixel than the ball, and that axis is escaped with its position and speed (fixed)
+// codes are packed 4 balls to a byte, each run of 8 code bytes is stored as a mask of the nonzero ones followed by them
+// walls are stored as their cell, col * rows + row, with the colour in the top bit
+const unsigned long REWIND_KEYFRAME_INTERVAL = 10 * FPS_CAP;
+
+// segments, a keyframe and the deltas after it, the ring can index
+const std::size_t MAX_REWIND_SEGMENTS = 4096;
+
+// bytes of a keyframe and a delta before any balls and walls, and before the rest of the header is known
+const std::size_t REWIND_KEYFRAME_HEADER = 15;
+const std::size_t REWIND_DELTA_HEADER = 10;
+const std::size_t REWIND_SIZE_HEADER = 5;
+
+const std::uint16_t REWIND_WALL_COLOUR = 0x8000;
+
+// longest tick a delta holds, longer ones are predicted as this and escaped
+const unsigned int MAX_REWIND_TICK_MS = 255;
+
+struct rewind_segment {
+    // byte offset of the keyframe, counted since recording began
+    std::uint64_t start;
+    std::uint64_t first_tick;
+    unsigned long ticks;
+};
+
+class rewind_buffer {
+    // history of the last ticks of gameplay for scrubbing while paused
+    private:
+        bool enabled;
+
+        std::vector<std::uint8_t> ring;
+        std::uint64_t head, tail;
+
+        std::vector<rewind_segment> segments;
+        std::size_t oldest, count;
+
+        // ticks recorded since the start
+        std::uint64_t ticks;
+
+        // encoder state, where the decoder will place each ball, its predicted speed, and where it really was on the last tick
+        std::vector<fixed> guess_x, guess_y, speed_x, speed_y, seen_x, seen_y;
+        std::size_t last_walls;
+        unsigned int last_level;
+
+        // record being encoded and one being decoded
+        std::vector<std::uint8_t> scratch;
+        std::vector<std::uint8_t> codes, escaped;
+        std::vector<std::uint8_t> reading;
+        std::vector<fixed> x, y, x_speed, y_speed;
+
+        // tick shown while scrubbing
+        bool scrubbing;
+        std::uint64_t position;
+
+        rewind_segment &segment(std::size_t n);
+        const rewind_segment &segment(std::size_t n) const;
+        void drop_oldest();
+        void push(std::size_t bytes, bool keyframe);
+        void read(std::uint64_t offset, std::size_t bytes);
+        std::size_t read_record(std::uint64_t offset);
+        std::size_t record_bytes(std::size_t balls, std::size_t walls) const;
+        std::size_t encode_keyframe(const state &game_state, const std::vector<wall> &walls_list, const std::vector<ball> &balls_list);
+        std::size_t encode_delta(const state &game_state, const std::vector<wall> &walls_list, const std::vector<ball> &balls_list);
+
+    public:
+        rewind_buffer();
+
+        // keep up to megabytes of history, storage is sized up front for the given balls and cells
+        void init(unsigned int megabytes, std::size_t balls, std::size_t cells);
+        bool is_enabled() const;
+
+        // add the tick just simulated
+        void record(const state &game_state, const std::vector<wall> &walls_list, const std::vector<ball> &balls_list);
+
+        // move the scrub position by ticks, back if negative, clamped to what is held
+        void scrub(long offset);
+        void stop_scrubbing();
+        bool is_scrubbing() const;
+
+        // decode the scrubbed tick into frame
+        bool load(snapshot &frame);
+
+        // seconds of gameplay held and bytes they take
+        double seconds() const;
+        std::uint64_t bytes() const;
+};
+
+// REWIND BUFFER CLASS
+rewind_buffer::rewind_buffer() {
+    enabled = false;
+    head = tail = 0;
+    oldest = count = 0;
+    ticks = 0;
+    last_walls = 0;
+    last_level = 0;
+    scrubbing = false;
+    position = 0;
+}
+void rewind_buffer::init(unsigned int megabytes, std::size_t balls, std::size_t cells) {
+    enabled = megabytes > 0;
+    if (!enabled) { return; }
+    ring.assign(std::size_t(megabytes) << 20, 0);
+    segments.assign(MAX_REWIND_SEGMENTS, rewind_segment{0, 0, 0});
+    for (std::vector<fixed>* v : {&guess_x, &guess_y, &speed_x, &speed_y, &seen_x, &seen_y, &x, &y, &x_speed, &y_speed}) { v->reserve(balls); }
+    scratch.reserve(record_bytes(balls, cells));
+    reading.reserve(record_bytes(balls, cells));
+    codes.reserve(balls / 4 + 1);
+    escaped.reserve(16 * balls);
+}
+bool rewind_buffer::is_enabled() const { return enabled; }
+rewind_segment &rewind_buffer::segment(std::size_t n) { return segments[(oldest + n) % segments.size()]; }
+const rewind_segment &rewind_buffer::segment(std::size_t n) const { return segments[(oldest + n) % segments.size()]; }
+std::size_t rewind_buffer::record_bytes(std::size_t balls, std::size_t walls) const {
+    // the most a keyframe or a delta can take, a delta with every axis escaped is the larger
+    const std::size_t code_bytes = balls / 4 + 1;
+    return REWIND_KEYFRAME_HEADER + 16*balls + code_bytes + code_bytes / 8 + 1 + 2*walls;
+}
+void rewind_buffer::drop_oldest() {
+    oldest = (oldest + 1) % segments.size();
+    --count;
+    head = (count > 0) ? segment(0).start : tail;
+}
+void rewind_buffer::push(std::size_t bytes, bool keyframe) {
+    // a segment never outgrows the ring, so start over from a keyframe before it would
+    if (keyframe) {
+        if (count == segments.size()) { drop_oldest(); }
+        segments[(oldest + count) % segments.size()] = rewind_segment{tail, ticks, 0};
+        ++count;
+    }
+
+    // make room by dropping whole segments, the one being written stays
+    while (tail + bytes - head > ring.size() && count > 1) { drop_oldest(); }
+
+    const std::size_t at = tail % ring.size();
+    const std::size_t first = std::min(bytes, ring.size() - at);
+    std::memcpy(&ring[at], scratch.data(), first);
+    std::memcpy(&ring[0], scratch.data() + first, bytes - first);
+    tail += bytes;
+    ++segment(count - 1).ticks;
+    ++ticks;
+}
+void rewind_buffer::read(std::uint64_t offset, std::size_t bytes) {
+    bytes = std::min(bytes, ring.size());
+    reading.resize(bytes);
+    const std::size_t at = offset % ring.size();
+    const std::size_t first = std::min(bytes, ring.size() - at);
+    std::memcpy(reading.data(), &ring[at], first);
+    std::memcpy(reading.data() + first, &ring[0], bytes - first);
+}
+
+// little endian helpers over the record being encoded or decoded
+void put_u16(std::uint8_t* &out, std::uint16_t value) { *out++ = value & 0xff; *out++ = value >> 8; }
+void put_u32(std::uint8_t* &out, std::uint32_t value) { put_u16(out, value & 0xffff); put_u16(out, value >> 16); }
+void put_fixed(std::uint8_t* &out, fixed value) { put_u32(out, static_cast<std::uint32_t>(value)); }
+std::uint16_t get_u16(const std::uint8_t* &in) { const std::uint16_t value = in[0] | (in[1] << 8); in += 2; return value; }
+std::uint32_t get_u32(const std::uint8_t* &in) { const std::uint32_t low = get_u16(in); return low | (std::uint32_t(get_u16(in)) << 16); }
+fixed get_fixed(const std::uint8_t* &in) { return static_cast<fixed>(get_u32(in)); }
+
+std::size_t rewind_buffer::read_record(std::uint64_t offset) {
+    // the record at offset into reading, returns its size
+    read(offset, REWIND_SIZE_HEADER);
+    const std::uint8_t* in = reading.data() + 1;
+    const std::size_t bytes = get_u32(in);
+    read(offset, bytes);
+    return bytes;
+}
+
+std::uint16_t rewind_wall_cell(const wall &w) {
+    const int rows = (SCREEN_HEIGHT - 2*GRID_Y_OFFSET) / GRID_DIM;
+    const int cell = ((w.hitbox.x - GRID_X_OFFSET) / GRID_DIM) * rows + (w.hitbox.y - GRID_Y_OFFSET) / GRID_DIM;
+    return static_cast<std::uint16_t>(cell) | (w.colour ? REWIND_WALL_COLOUR : 0);
+}
+
+wall rewind_cell_wall(std::uint16_t cell) {
+    const int rows = (SCREEN_HEIGHT - 2*GRID_Y_OFFSET) / GRID_DIM;
+    const int index = cell & ~REWIND_WALL_COLOUR;
+    SDL_Rect hitbox;
+    hitbox.x = GRID_X_OFFSET + (index / rows) * GRID_DIM;
+    hitbox.y = GRID_Y_OFFSET + (index % rows) * GRID_DIM;
+    hitbox.w = GRID_DIM;
+    hitbox.h = GRID_DIM;
+    return wall(hitbox, false, (cell & REWIND_WALL_COLOUR) != 0);
+}
+
+fixed rewind_position(float position) {
+    // fixed point position on the same pixel the ball is drawn on
+    const int pixel = static_cast<int>(position);
+    return std::clamp(float_to_fixed(position), to_fixed(pixel), to_fixed(pixel + 1) - 1);
+}
+
+fixed rewind_predict(fixed position, fixed speed, unsigned int tick_ms) {
+    return position + static_cast<fixed>(fixed_wide(speed) * tick_ms);
+}
+
+std::size_t rewind_buffer::encode_keyframe(const state &game_state, const std::vector<wall> &walls_list, const std::vector<ball> &balls_list) {
+    const std::size_t balls = balls_list.size();
+    scratch.resize(record_bytes(balls, walls_list.size()));
+
+    // keep the speeds while the same balls carry on, so the next delta predicts well
+    const bool carry_on = (guess_x.size() == balls) && (last_level == game_state.current_level);
+    for (std::vector<fixed>* v : {&guess_x, &guess_y, &speed_x, &speed_y, &seen_x, &seen_y}) { v->resize(balls); }
+
+    std::uint8_t* out = scratch.data() + REWIND_SIZE_HEADER;
+    *out++ = game_state.current_level;
+    *out++ = game_state.current_lives;
+    *out++ = static_cast<unsigned int>(game_state.current_percentage);
+    put_u32(out, balls);
+    put_u16(out, walls_list.size());
+    for (std::size_t n = 0; n < balls; ++n) {
+        seen_x[n] = guess_x[n] = rewind_position(balls_list[n].x_pos);
+        seen_y[n] = guess_y[n] = rewind_position(balls_list[n].y_pos);
+        if (!carry_on) { speed_x[n] = speed_y[n] = 0; }
+        put_fixed(out, guess_x[n]);
+        put_fixed(out, guess_y[n]);
+        put_fixed(out, speed_x[n]);
+        put_fixed(out, speed_y[n]);
+    }
+    for (const wall &w : walls_list) { put_u16(out, rewind_wall_cell(w)); }
+
+    const std::size_t bytes = out - scratch.data();
+    out = scratch.data();
+    *out++ = 'K';
+    put_u32(out, bytes);
+    return bytes;
+}
+std::size_t rewind_buffer::encode_delta(const state &game_state, const std::vector<wall> &walls_list, const std::vector<ball> &balls_list) {
+    const std::size_t balls = balls_list.size();
+    const std::size_t new_walls = walls_list.size() - last_walls;
+    const unsigned int tick_ms = std::min(game_state.tick_ms, MAX_REWIND_TICK_MS);
+    scratch.resize(record_bytes(balls, new_walls));
+
+    std::uint8_t* out = scratch.data() + REWIND_SIZE_HEADER;
+    *out++ = game_state.current_lives;
+    *out++ = static_cast<unsigned int>(game_state.current_percentage);
+    *out++ = tick_ms;
+    put_u16(out, new_walls);
+    for (std::size_t w = last_walls; w < walls_list.size(); ++w) { put_u16(out, rewind_wall_cell(walls_list[w])); }
+
+    // predict every axis, escape the ones that land on the wrong pixel
+    codes.assign(balls / 4 + 1, 0);
+    escaped.resize(16 * balls);
+    std::uint8_t* escapes = escaped.data();
+    for (std::size_t n = 0; n < balls; ++n) {
+        const float position[2] = {balls_list[n].x_pos, balls_list[n].y_pos};
+        fixed* guess[2] = {&guess_x[n], &guess_y[n]};
+        fixed* speed[2] = {&speed_x[n], &speed_y[n]};
+        fixed* seen[2] = {&seen_x[n], &seen_y[n]};
+        for (int axis = 0; axis < 2; ++axis) {
+            const fixed actual = rewind_position(position[axis]);
+            *guess[axis] = rewind_predict(*guess[axis], *speed[axis], tick_ms);
+            if (fixed_floor(*guess[axis]) != fixed_floor(actual)) {
+                if (tick_ms > 0) { *speed[axis] = (actual - *seen[axis]) / static_cast<fixed>(tick_ms); }
+                *guess[axis] = actual;
+                put_fixed(escapes, actual);
+                put_fixed(escapes, *speed[axis]);
+                codes[n / 4] |= 1 << (2 * (n % 4) + axis);
+            }
+            *seen[axis] = actual;
+        }
+    }
+
+    // runs of 8 code bytes behind a mask of the nonzero ones, most are zero while balls fly straight
+    for (std::size_t run = 0; run < codes.size(); run += 8) {
+        std::uint8_t* mask = out++;
+        *mask = 0;
+        for (std::size_t n = run; n < std::min(run + 8, codes.size()); ++n) {
+            if (codes[n] != 0) {
+                *mask |= 1 << (n - run);
+                *out++ = codes[n];
+            }
+        }
+    }
+    const std::size_t escaped_bytes = escapes - escaped.data();
+    std::memcpy(out, escaped.data(), escaped_bytes);
+    out += escaped_bytes;
+
+    const std::size_t bytes = out - scratch.data();
+    out = scratch.data();
+    *out++ = 'D';
+    put_u32(out, bytes);
+    return bytes;
+}
+void rewind_buffer::record(const state &game_state, const std::vector<wall> &walls_list, const std::vector<ball> &balls_list) {
+    if (!enabled) { return; }
+    trace_zone zone("rewind_record");
+
+    // keyframe at the interval, whenever the level changes under the deltas, and before a segment could outgrow the ring
+    bool keyframe = (count == 0) || (segment(count - 1).ticks >= REWIND_KEYFRAME_INTERVAL) || (balls_list.size() != guess_x.size()) || (walls_list.size() < last_walls) || (game_state.current_level != last_level);
+    keyframe = keyframe || (tail - segment(count - 1).start + record_bytes(balls_list.size(), walls_list.size() - last_walls) > ring.size());
+    const std::size_t bytes = keyframe ? encode_keyframe(game_state, walls_list, balls_list) : encode_delta(game_state, walls_list, balls_list);
+    last_walls = walls_list.size();
+    last_level = game_state.current_level;
+
+    // a keyframe larger than the whole ring is not kept, nor is anything after it until one fits
+    if (bytes > ring.size()) {
+        while (count > 0) { drop_oldest(); }
+        guess_x.clear();
+        return;
+    }
+    push(bytes, keyframe);
+}
+void rewind_buffer::scrub(long offset) {
+    if (!enabled || count == 0) { return; }
+    const std::uint64_t first = segment(0).first_tick;
+    const std::uint64_t last = ticks - 1;
+    if (!scrubbing) { position = last; }
+    scrubbing = true;
+    const long long target = static_cast<long long>(position) + offset;
+    position = std::clamp<long long>(target, first, last);
+}
+void rewind_buffer::stop_scrubbing() { scrubbing = false; }
+bool rewind_buffer::is_scrubbing() const { return scrubbing; }
+bool rewind_buffer::load(snapshot &frame) {
+    // the oldest segments may have been dropped since the position was set
+    if (!scrubbing || count == 0) { return false; }
+    position = std::max(position, segment(0).first_tick);
+
+    // newest segment starting at or before the position
+    std::size_t lo = 0, hi = count - 1;
+    while (lo < hi) {
+        const std::size_t mid = (lo + hi + 1) / 2;
+        if (segment(mid).first_tick <= position) { lo = mid; } else { hi = mid - 1; }
+    }
+    const rewind_segment &found = segment(lo);
+
+    // keyframe
+    std::uint64_t offset = found.start;
+    offset += read_record(offset);
+    const std::uint8_t* in = reading.data() + REWIND_SIZE_HEADER;
+    frame.level = *in++;
+    frame.lives = *in++;
+    frame.percentage = *in++;
+    const std::size_t balls = get_u32(in);
+    const std::size_t walls = get_u16(in);
+    for (std::vector<fixed>* v : {&x, &y, &x_speed, &y_speed}) { v->resize(balls); }
+    for (std::size_t n = 0; n < balls; ++n) {
+        x[n] = get_fixed(in);
+        y[n] = get_fixed(in);
+        x_speed[n] = get_fixed(in);
+        y_speed[n] = get_fixed(in);
+    }
+    frame.walls.clear();
+    for (std::size_t w = 0; w < walls; ++w) { frame.walls.emplace_back(rewind_cell_wall(get_u16(in))); }
+
+    // deltas up to the position
+    codes.resize(balls / 4 + 1);
+    for (std::uint64_t tick = found.first_tick; tick < position; ++tick) {
+        offset += read_record(offset);
+        in = reading.data() + REWIND_SIZE_HEADER;
+        frame.lives = *in++;
+        frame.percentage = *in++;
+        const unsigned int tick_ms = *in++;
+        const std::size_t new_walls = get_u16(in);
+        for (std::size_t w = 0; w < new_walls; ++w) { frame.walls.emplace_back(rewind_cell_wall(get_u16(in))); }
+
+        for (std::size_t run = 0; run < codes.size(); run += 8) {
+            const std::uint8_t mask = *in++;
+            for (std::size_t n = run; n < std::min(run + 8, codes.size()); ++n) {
+                codes[n] = (mask & (1 << (n - run))) ? *in++ : 0;
+            }
+        }
+        for (std::size_t n = 0; n < balls; ++n) {
+            fixed* guess[2] = {&x[n], &y[n]};
+            fixed* speed[2] = {&x_speed[n], &y_speed[n]};
+            for (int axis = 0; axis < 2; ++axis) {
+                if (codes[n / 4] & (1 << (2 * (n % 4) + axis))) {
+                    *guess[axis] = get_fixed(in);
+                    *speed[axis] = get_fixed(in);
+                } else {
+                    *guess[axis] = rewind_predict(*guess[axis], *speed[axis], tick_ms);
+                }
+            }
+        }
+    }
+
+    frame.balls.resize(balls);
+    for (std::size_t n = 0; n < balls; ++n) {
+        frame.balls[n].first = fixed_floor(x[n]);
+        frame.balls[n].second = fixed_floor(y[n]);
+    }
+    index_snapshot(frame);
+    return true;
+}
+double rewind_buffer::seconds() const {
+    if (count == 0) { return 0; }
+    return double(ticks - segment(0).first_tick) / FPS_CAP;
+}
+std::uint64_t rewind_buffer::bytes() const { return tail - head; }
+
+void rewind_handle(rewind_buffer &history) {
+    // scrub while paused, left and right arrows by a tick, brackets by a second
+    if (event.type != SDL_KEYDOWN) { return; }
+    switch (event.key.keysym.sym) {
+        case SDLK_LEFT: history.scrub(-1); break;
+        case SDLK_RIGHT: history.scrub(1); break;
+        case SDLK_LEFTBRACKET: history.scrub(-FPS_CAP); break;
+        case SDLK_RIGHTBRACKET: history.scrub(FPS_CAP); break;
+        default: break;
+    }
+}
@@ -0,0 +1,356 @@
+#pragma once
+#include "SDL/SDL.h"
+#include <vector>
+#include <array>
+#include <cstring>
+#include <algorithm>
+#include <cstdint>
+
+// SCALING
+// the game always renders its logical 800x600 frame, which is presented at the requested resolution
+
+// side of the square tiles the logical frame is compared in, only tiles that changed are scaled again
+const int SCALE_TILE = 32;
+
+// bytes blended per vector block
+const int SCALE_BLOCK = 16;
+
+// weights of the bilinear filter are 8 bit fractions of this
+const Uint32 SCALE_WEIGHT_ONE = 256;
+
+Uint32 lerp_pixel(Uint32 a, Uint32 b, Uint32 weight) {
+    // blend two 32 bit pixels, all four channels at once in two 16 bit lanes per word
+    const Uint32 inverse = SCALE_WEIGHT_ONE - weight;
+    const Uint32 odd = ((((a & 0x00ff00ff) * inverse) + ((b & 0x00ff00ff) * weight)) >> 8) & 0x00ff00ff;
+    const Uint32 even = ((((a >> 8) & 0x00ff00ff) * inverse) + (((b >> 8) & 0x00ff00ff) * weight)) & 0xff00ff00;
+    return odd | even;
+}
+
+void blend_rows(const Uint8* __restrict upper, const Uint8* __restrict lower, Uint8* __restrict out, int bytes, Uint32 weight) {
+    // blend two rows byte by byte, every channel fits a 16 bit lane so the compiler turns this into packed multiplies
+    // blocks have a fixed length so they vectorize without a remainder loop even at -O2
+    const std::uint16_t lower_weight = std::uint16_t(weight);
+    const std::uint16_t upper_weight = std::uint16_t(SCALE_WEIGHT_ONE - weight);
+    int i = 0;
+    for (; i + SCALE_BLOCK <= bytes; i += SCALE_BLOCK) {
+        for (int b = i; b < i + SCALE_BLOCK; ++b) {
+            out[b] = Uint8(std::uint16_t(upper[b]*upper_weight + lower[b]*lower_weight) >> 8);
+        }
+    }
+    for (; i < bytes; ++i) {
+        out[i] = Uint8(std::uint16_t(upper[i]*upper_weight + lower[i]*lower_weight) >> 8);
+    }
+}
+
+class scaler {
+    private:
+        bool enabled;
+        scale_filter filter;
+        int source_w, source_h;
+        int target_w, target_h;
+
+        // nearest: source column and row sampled by each target column and row
+        // bilinear: left or top source column and row, and the weight of the one after it
+        std::vector<int> x_index, y_index;
+        std::vector<Uint32> x_weight, y_weight;
+
+        // logical frame as last scaled, in the bytes of its 8 or 32 bit pixels, and which tiles differ from it
+        std::vector<Uint8> previous;
+        std::vector<unsigned char> dirty;
+        int tiles_x, tiles_y;
+        bool first;
+
+        // a page flipped target holds the frame from two flips ago, so every tile is scaled on every call
+        bool every_tile;
+
+        // bilinear source rows scaled horizontally, before they are blended vertically
+        std::array<std::vector<Uint32>, 2> horizontal;
+
+        // target pixel of each palette entry, 8 bit sources are expanded through it as they are sampled
+        std::array<Uint32, 256> palette;
+
+        Uint32 expand(Uint32 pixel) const;
+        Uint32 expand(Uint8 pixel) const;
+
+        void build_tables();
+
+        template <typename Pixel> void mark_dirty(const Pixel* source, int source_pitch);
+        template <typename Pixel> void scale_rect(const Pixel* source, int source_pitch, Uint32* target, int target_pitch, int x_0, int y_0, int x_1, int y_1);
+        template <typename Pixel> void scale_nearest(const Pixel* source, int source_pitch, Uint32* target, int target_pitch, int x_0, int y_0, int x_1, int y_1);
+        template <typename Pixel> void horizontal_pass(const Pixel* in, Uint32* out, int x_0, int x_1);
+        template <typename Pixel> void scale_bilinear(const Pixel* source, int source_pitch, Uint32* target, int target_pitch, int x_0, int y_0, int x_1, int y_1);
+        template <typename Pixel> void scale_pixels(const Pixel* in, int in_pitch, Uint32* out, int out_pitch);
+
+    public:
+        scaler();
+
+        // prepare sample tables for scaling source sized frames to target size, nothing is scaled if the sizes match
+        void init(int source_width, int source_height, int target_width, int target_height, scale_filter f);
+        bool is_enabled() const;
+
+        // scale every tile on every call instead of only those that changed, for targets that are page flipped
+        void scale_every_tile(bool on);
+
+        // map the entries of an 8 bit source's palette to target pixels, every tile is scaled again on the next call
+        void set_palette(const SDL_Palette* colours, const SDL_PixelFormat* target);
+
+        // scale the tiles of source that changed since the last call into target, 32 bit in the same format or 8 bit with the palette set
+        bool present(SDL_Surface* source, SDL_Surface* target);
+
+        // the same into target pixels with the surfaces already locked, a 32 bit frame of the target size is copied as it is
+        void scale(const SDL_Surface* source, Uint32* out, int out_pitch);
+
+        // map a target position back to the logical frame
+        int source_x(int x) const;
+        int source_y(int y) const;
+};
+
+scaler screen_scaler;
+
+// SCALER CLASS
+scaler::scaler() {
+    enabled = false;
+    filter = scale_filter::nearest;
+    source_w = source_h = target_w = target_h = 0;
+    tiles_x = tiles_y = 0;
+    first = true;
+    every_tile = false;
+    palette.fill(0);
+}
+void scaler::init(int source_width, int source_height, int target_width, int target_height, scale_filter f) {
+    source_w = source_width;
+    source_h = source_height;
+    target_w = target_width;
+    target_h = target_height;
+    filter = f;
+    enabled = (source_w != target_w) || (source_h != target_h);
+    if (enabled) { build_tables(); }
+}
+void scaler::build_tables() {
+    // sample at pixel centres
+    const scale_filter f = filter;
+    auto build = [f](int source_size, int target_size, std::vector<int> &index, std::vector<Uint32> &weight) {
+        index.resize(target_size);
+        weight.resize(target_size);
+        for (int t = 0; t < target_size; ++t) {
+            if (f == scale_filter::nearest) {
+                index[t] = std::min(((2*t + 1) * source_size) / (2*target_size), source_size - 1);
+                weight[t] = 0;
+            } else {
+                // position in 1/256 source pixels, clamped so both samples stay inside
+                const long long position = std::max(0LL, ((2LL*t + 1) * source_size * SCALE_WEIGHT_ONE) / (2LL*target_size) - SCALE_WEIGHT_ONE/2);
+                int left = int(position / SCALE_WEIGHT_ONE);
+                Uint32 fraction = Uint32(position % SCALE_WEIGHT_ONE);
+                if (left >= source_size - 1) {
+                    left = source_size - 2;
+                    fraction = SCALE_WEIGHT_ONE;
+                }
+                index[t] = left;
+                weight[t] = fraction;
+            }
+        }
+    };
+    build(source_w, target_w, x_index, x_weight);
+    build(source_h, target_h, y_index, y_weight);
+
+    tiles_x = (source_w + SCALE_TILE - 1) / SCALE_TILE;
+    tiles_y = (source_h + SCALE_TILE - 1) / SCALE_TILE;
+    previous.assign(std::size_t(source_w) * source_h * sizeof(Uint32), 0);
+    dirty.assign(std::size_t(tiles_x) * tiles_y, 1);
+    horizontal[0].assign(target_w, 0);
+    horizontal[1].assign(target_w, 0);
+    first = true;
+}
+bool scaler::is_enabled() const { return enabled; }
+void scaler::scale_every_tile(bool on) {
+    every_tile = on;
+    first = true;
+}
+int scaler::source_x(int x) const { return enabled ? std::clamp(x * source_w / target_w, 0, source_w - 1) : x; }
+int scaler::source_y(int y) const { return enabled ? std::clamp(y * source_h / target_h, 0, source_h - 1) : y; }
+void scaler::set_palette(const SDL_Palette* colours, const SDL_PixelFormat* target) {
+    palette.fill(0);
+    for (int n = 0; n < std::min(colours->ncolors, 256); ++n) {
+        palette[n] = SDL_MapRGB(const_cast<SDL_PixelFormat*>(target), colours->colors[n].r, colours->colors[n].g, colours->colors[n].b);
+    }
+    first = true;
+
+    // same size 8 bit frames are expanded one to one, by tiles so unchanged ones are skipped unless the target is page flipped
+    if (!enabled) {
+        filter = scale_filter::nearest;
+        build_tables();
+    }
+}
+Uint32 scaler::expand(Uint32 pixel) const { return pixel; }
+Uint32 scaler::expand(Uint8 pixel) const { return palette[pixel]; }
+template <typename Pixel>
+void scaler::mark_dirty(const Pixel* source, int source_pitch) {
+    if (every_tile) {
+        std::fill(dirty.begin(), dirty.end(), 1);
+        return;
+    }
+
+    // compare each tile against the last scaled frame and keep the new pixels of those that changed
+    for (int ty = 0; ty < tiles_y; ++ty) {
+        const int y_0 = ty * SCALE_TILE;
+        const int y_1 = std::min(y_0 + SCALE_TILE, source_h);
+        for (int tx = 0; tx < tiles_x; ++tx) {
+            const int x_0 = tx * SCALE_TILE;
+            const std::size_t bytes = std::size_t(std::min(x_0 + SCALE_TILE, source_w) - x_0) * sizeof(Pixel);
+            bool changed = first;
+            for (int y = y_0; y < y_1 && !changed; ++y) {
+                changed = std::memcmp(source + std::size_t(y)*source_pitch + x_0, &previous[(std::size_t(y)*source_w + x_0) * sizeof(Pixel)], bytes) != 0;
+            }
+            if (changed) {
+                for (int y = y_0; y < y_1; ++y) {
+                    std::memcpy(&previous[(std::size_t(y)*source_w + x_0) * sizeof(Pixel)], source + std::size_t(y)*source_pitch + x_0, bytes);
+                }
+            }
+            dirty[std::size_t(ty)*tiles_x + tx] = changed;
+        }
+    }
+    first = false;
+}
+template <typename Pixel>
+void scaler::scale_nearest(const Pixel* source, int source_pitch, Uint32* target, int target_pitch, int x_0, int y_0, int x_1, int y_1) {
+    const int* columns = x_index.data();
+    for (int y = y_0; y < y_1; ++y) {
+        Uint32* out = target + std::size_t(y)*target_pitch;
+
+        // rows sampling the same source row are copies of the one above
+        if (y > y_0 && y_index[y] == y_index[y - 1]) {
+            std::memcpy(out + x_0, out - target_pitch + x_0, std::size_t(x_1 - x_0) * sizeof(Uint32));
+            continue;
+        }
+
+        const Pixel* in = source + std::size_t(y_index[y])*source_pitch;
+        for (int x = x_0; x < x_1; ++x) { out[x] = expand(in[columns[x]]); }
+    }
+}
+template <typename Pixel>
+void scaler::horizontal_pass(const Pixel* in, Uint32* out, int x_0, int x_1) {
+    for (int x = x_0; x < x_1; ++x) {
+        const int c = x_index[x];
+        out[x] = lerp_pixel(expand(in[c]), expand(in[c + 1]), x_weight[x]);
+    }
+}
+template <typename Pixel>
+void scaler::scale_bilinear(const Pixel* source, int source_pitch, Uint32* target, int target_pitch, int x_0, int y_0, int x_1, int y_1) {
+    // rows are scaled horizontally once per source row and kept while target rows still sample them
+    int cached[2] = {-1, -1};
+    Uint32* rows[2] = {horizontal[0].data(), horizontal[1].data()};
+    for (int y = y_0; y < y_1; ++y) {
+        const int top = y_index[y];
+        if (cached[0] != top) {
+            if (cached[1] == top) {
+                std::swap(rows[0], rows[1]);
+                std::swap(cached[0], cached[1]);
+            } else {
+                horizontal_pass(source + std::size_t(top)*source_pitch, rows[0], x_0, x_1);
+                cached[0] = top;
+            }
+        }
+        if (cached[1] != top + 1) {
+            horizontal_pass(source + std::size_t(top + 1)*source_pitch, rows[1], x_0, x_1);
+            cached[1] = top + 1;
+        }
+
+        // blend the two rows
+        Uint32* out = target + std::size_t(y)*target_pitch;
+        blend_rows(reinterpret_cast<const Uint8*>(rows[0] + x_0), reinterpret_cast<const Uint8*>(rows[1] + x_0), reinterpret_cast<Uint8*>(out + x_0), (x_1 - x_0) * 4, y_weight[y]);
+    }
+}
+template <typename Pixel>
+void scaler::scale_rect(const Pixel* source, int source_pitch, Uint32* target, int target_pitch, int x_0, int y_0, int x_1, int y_1) {
+    if (filter == scale_filter::nearest) {
+        scale_nearest(source, source_pitch, target, target_pitch, x_0, y_0, x_1, y_1);
+    } else {
+        scale_bilinear(source, source_pitch, target, target_pitch, x_0, y_0, x_1, y_1);
+    }
+}
+bool scaler::present(SDL_Surface* source, SDL_Surface* target) {
+    if ((source->format->BytesPerPixel != 4 && source->format->BytesPerPixel != 1) || target->format->BytesPerPixel != 4) { return false; }
+    if (SDL_MUSTLOCK(source) && SDL_LockSurface(source) == -1) { return false; }
+    if (SDL_MUSTLOCK(target) && SDL_LockSurface(target) == -1) {
+        if (SDL_MUSTLOCK(source)) { SDL_UnlockSurface(source); }
+        return false;
+    }
+
+    scale(source, static_cast<Uint32*>(target->pixels), target->pitch / 4);
+
+    if (SDL_MUSTLOCK(target)) { SDL_UnlockSurface(target); }
+    if (SDL_MUSTLOCK(source)) { SDL_UnlockSurface(source); }
+    return true;
+}
+void scaler::scale(const SDL_Surface* source, Uint32* out, int out_pitch) {
+    if (source->format->BytesPerPixel == 1) {
+        scale_pixels(static_cast<const Uint8*>(source->pixels), source->pitch, out, out_pitch);
+    } else {
+        scale_pixels(static_cast<const Uint32*>(source->pixels), source->pitch / 4, out, out_pitch);
+    }
+}
+template <typename Pixel>
+void scaler::scale_pixels(const Pixel* in, int in_pitch, Uint32* out, int out_pitch) {
+    if constexpr (sizeof(Pixel) == sizeof(Uint32)) {
+        if (!enabled) {
+            for (int y = 0; y < source_h; ++y) { std::memcpy(out + std::size_t(y)*out_pitch, in + std::size_t(y)*in_pitch, std::size_t(source_w) * sizeof(Uint32)); }
+            return;
+        }
+    } else {
+        // same size into a page flipped target, every row is expanded whole
+        if (!enabled && every_tile) {
+            for (int y = 0; y < source_h; ++y) {
+                const Pixel* row = in + std::size_t(y)*in_pitch;
+                Uint32* expanded = out + std::size_t(y)*out_pitch;
+                for (int x = 0; x < source_w; ++x) { expanded[x] = expand(row[x]); }
+            }
+            stats.add(SCALED_PIXELS, std::size_t(source_w) * source_h);
+            return;
+        }
+    }
+    mark_dirty(in, in_pitch);
+
+    // bilinear samples reach one source pixel past a tile
+    const int reach = (filter == scale_filter::bilinear) ? 1 : 0;
+    unsigned long pixels = 0;
+    for (int ty = 0; ty < tiles_y; ++ty) {
+        for (int tx = 0; tx < tiles_x; ++tx) {
+            if (!dirty[std::size_t(ty)*tiles_x + tx]) { continue; }
+
+            // merge the run of dirty tiles along the row into one rect
+            int run = tx;
+            while (run + 1 < tiles_x && dirty[std::size_t(ty)*tiles_x + run + 1]) { ++run; }
+            const int sx_0 = std::max(tx*SCALE_TILE - reach, 0);
+            const int sx_1 = std::min((run + 1)*SCALE_TILE + reach, source_w);
+            const int sy_0 = std::max(ty*SCALE_TILE - reach, 0);
+            const int sy_1 = std::min((ty + 1)*SCALE_TILE + reach, source_h);
+
+            // target pixels sampling the source rect, widened by one so rounding never leaves a stale edge
+            const int x_0 = std::max(sx_0 * target_w / source_w - 1, 0);
+            const int x_1 = std::min((sx_1 * target_w + source_w - 1) / source_w + 1, target_w);
+            const int y_0 = std::max(sy_0 * target_h / source_h - 1, 0);
+            const int y_1 = std::min((sy_1 * target_h + source_h - 1) / source_h + 1, target_h);
+            scale_rect(in, in_pitch, out, out_pitch, x_0, y_0, x_1, y_1);
+            pixels += (unsigned long)(x_1 - x_0) * (y_1 - y_0);
+            tx = run;
+        }
+    }
+    stats.add(SCALED_PIXELS, pixels);
+}
+
+bool page_flipped(const SDL_Surface* surface) {
+    // hardware double buffered, each flip shows the back buffer and hands back the one shown before it
+    return (surface->flags & SDL_HWSURFACE) && (surface->flags & SDL_DOUBLEBUF);
+}
+
+void scale_mouse_event(SDL_Event &e) {
+    // map mouse coordinates from the window back to the logical frame
+    if (!screen_scaler.is_enabled()) { return; }
+    if (e.type == SDL_MOUSEBUTTONDOWN || e.type == SDL_MOUSEBUTTONUP) {
+        e.button.x = screen_scaler.source_x(e.button.x);
+        e.button.y = screen_scaler.source_y(e.button.y);
+    } else if (e.type == SDL_MOUSEMOTION) {
+        e.motion.x = screen_scaler.source_x(e.motion.x);
+        e.motion.y = screen_scaler.source_y(e.motion.y);
+    }
+}
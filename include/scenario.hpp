@@ -0,0 +1,327 @@
+#pragma once
+#include "SDL/SDL.h"
+#include <vector>
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+// SCENARIO FILES
+// line based text, '#' starts a comment, the first line is "jezzball-scenario <version>"
+//     name <text>
+//     board <columns> <rows>                                         must match the playfield
+//     level <level>
+//     lives <lives>
+//     ball <x> <y> <x_speed> <y_speed>                               pixels and pixels per second
+//     balls <x> <y> <columns> <rows> <spacing> <x_speed> <y_speed>   lattice of balls
+//     wall <column> <row> <black|white>                              built wall cell
+//     captured <column> <row> <column> <row>                         filled rectangle of cells, inclusive
+//     at <frame> place <column> <row> <vertical|horizontal>
+//     at <frame> pause
+//     at <frame> quit
+const int SCENARIO_VERSION = 1;
+
+// bytes read from the file at a time
+const std::size_t SCENARIO_CHUNK_SIZE = 1 << 16;
+
+// balls a scenario may spawn in all, so a typo in a lattice cannot ask for more memory than there is
+const std::size_t SCENARIO_MAX_BALLS = 1 << 18;
+
+enum class scenario_action : unsigned char {
+    place,
+    pause,
+    quit,
+};
+
+struct scenario_ball {
+    float x, y;
+    float x_speed, y_speed;
+};
+
+struct scenario_wall {
+    int col, row;
+    bool colour;
+};
+
+struct scenario_region {
+    int col_0, row_0;
+    int col_1, row_1;
+};
+
+struct scenario_input {
+    unsigned long frame;
+    scenario_action action;
+    int col, row;
+    orientation wall_orientation;
+};
+
+struct scenario {
+    std::string name;
+    int version = 0;
+    unsigned int level = 1;
+    unsigned int lives = 5;
+
+    std::vector<scenario_ball> balls;
+    std::vector<scenario_wall> walls;
+    std::vector<scenario_region> regions;
+
+    // scripted input, ordered by frame
+    std::vector<scenario_input> inputs;
+};
+
+bool next_token(std::string_view &line, std::string_view &token) {
+    // split the next whitespace separated token off the line
+    std::size_t start = line.find_first_not_of(" \t\r");
+    if (start == std::string_view::npos) { return false; }
+    std::size_t end = line.find_first_of(" \t\r", start);
+    if (end == std::string_view::npos) { end = line.size(); }
+    token = line.substr(start, end - start);
+    line.remove_prefix(end);
+    return true;
+}
+
+template <typename T>
+bool next_number(std::string_view &line, T &value) {
+    std::string_view token;
+    if (!next_token(line, token)) { return false; }
+    const std::from_chars_result result = std::from_chars(token.data(), token.data() + token.size(), value);
+    return (result.ec == std::errc()) && (result.ptr == token.data() + token.size());
+}
+
+bool parse_scenario_line(std::string_view line, scenario &script, std::string &error) {
+    // strip comment
+    const std::size_t comment = line.find('#');
+    if (comment != std::string_view::npos) { line = line.substr(0, comment); }
+
+    std::string_view directive;
+    if (!next_token(line, directive)) { return true; }
+
+    // header comes first
+    if (script.version == 0) {
+        if (directive != "jezzball-scenario" || !next_number(line, script.version) || script.version < 1) { error = "expected jezzball-scenario <version>"; return false; }
+        if (script.version > SCENARIO_VERSION) { error = "unsupported scenario version"; return false; }
+        return true;
+    }
+
+    const int cols = (SCREEN_WIDTH - 2*GRID_X_OFFSET) / GRID_DIM;
+    const int rows = (SCREEN_HEIGHT - 2*GRID_Y_OFFSET) / GRID_DIM;
+    bool valid = true;
+
+    // ball positions inside the playfield, and finite speeds
+    auto in_playfield = [](float x, float y) { return std::isfinite(x) && std::isfinite(y) && x >= GRID_X_OFFSET && x <= SCREEN_WIDTH - GRID_X_OFFSET && y >= GRID_Y_OFFSET && y <= SCREEN_HEIGHT - GRID_Y_OFFSET; };
+    auto valid_speed = [](const scenario_ball &b) { return std::isfinite(b.x_speed) && std::isfinite(b.y_speed); };
+
+    // NAME
+    if (directive == "name") {
+        const std::size_t start = line.find_first_not_of(" \t");
+        script.name = (start == std::string_view::npos) ? "" : std::string(line.substr(start));
+        line = std::string_view();
+
+    // BOARD
+    } else if (directive == "board") {
+        int board_cols, board_rows;
+        valid = next_number(line, board_cols) && next_number(line, board_rows);
+        if (valid && (board_cols != cols || board_rows != rows)) { error = "board must be " + std::to_string(cols) + "x" + std::to_string(rows); return false; }
+
+    // LEVEL
+    } else if (directive == "level") {
+        valid = next_number(line, script.level) && script.level >= 1 && script.level <= MAX_LEVEL;
+
+    // LIVES
+    } else if (directive == "lives") {
+        valid = next_number(line, script.lives) && script.lives >= 1 && script.lives <= 99;
+
+    // BALL
+    } else if (directive == "ball") {
+        scenario_ball b;
+        valid = next_number(line, b.x) && next_number(line, b.y) && next_number(line, b.x_speed) && next_number(line, b.y_speed);
+        if (valid && (!in_playfield(b.x, b.y) || !valid_speed(b))) { error = "ball must be inside the playfield with a finite speed"; return false; }
+        if (valid && script.balls.size() >= SCENARIO_MAX_BALLS) { error = "more than " + std::to_string(SCENARIO_MAX_BALLS) + " balls"; return false; }
+        if (valid) { script.balls.emplace_back(b); }
+
+    // BALL LATTICE
+    } else if (directive == "balls") {
+        scenario_ball b;
+        int lattice_cols, lattice_rows;
+        float spacing;
+        valid = next_number(line, b.x) && next_number(line, b.y) && next_number(line, lattice_cols) && next_number(line, lattice_rows) && next_number(line, spacing) && next_number(line, b.x_speed) && next_number(line, b.y_speed) && lattice_cols >= 0 && lattice_rows >= 0;
+        if (valid && (!std::isfinite(spacing) || !in_playfield(b.x, b.y) || !in_playfield(b.x + std::max(lattice_cols - 1, 0)*spacing, b.y + std::max(lattice_rows - 1, 0)*spacing) || !valid_speed(b))) {
+            error = "balls must be inside the playfield with a finite speed";
+            return false;
+        }
+        if (valid && std::size_t(lattice_cols)*std::size_t(lattice_rows) > SCENARIO_MAX_BALLS - script.balls.size()) { error = "more than " + std::to_string(SCENARIO_MAX_BALLS) + " balls"; return false; }
+        if (valid) {
+            script.balls.reserve(script.balls.size() + std::size_t(lattice_cols)*lattice_rows);
+            for (int r = 0; r < lattice_rows; ++r) {
+                for (int c = 0; c < lattice_cols; ++c) {
+                    script.balls.emplace_back(scenario_ball{b.x + c*spacing, b.y + r*spacing, b.x_speed, b.y_speed});
+                }
+            }
+        }
+
+    // WALL
+    } else if (directive == "wall") {
+        scenario_wall w;
+        std::string_view colour;
+        valid = next_number(line, w.col) && next_number(line, w.row) && next_token(line, colour) && (colour == "black" || colour == "white");
+        valid = valid && w.col >= 0 && w.col < cols && w.row >= 0 && w.row < rows;
+        if (valid) {
+            w.colour = (colour == "black");
+            script.walls.emplace_back(w);
+        }
+
+    // CAPTURED REGION
+    } else if (directive == "captured") {
+        scenario_region region;
+        valid = next_number(line, region.col_0) && next_number(line, region.row_0) && next_number(line, region.col_1) && next_number(line, region.row_1);
+        valid = valid && region.col_0 >= 0 && region.col_0 <= region.col_1 && region.col_1 < cols && region.row_0 >= 0 && region.row_0 <= region.row_1 && region.row_1 < rows;
+        if (valid) { script.regions.emplace_back(region); }
+
+    // INPUT
+    } else if (directive == "at") {
+        scenario_input input{};
+        std::string_view action;
+        valid = next_number(line, input.frame) && next_token(line, action);
+        if (valid && !script.inputs.empty() && input.frame < script.inputs.back().frame) { error = "inputs must be in frame order"; return false; }
+        if (valid && action == "place") {
+            std::string_view direction;
+            input.action = scenario_action::place;
+            valid = next_number(line, input.col) && next_number(line, input.row) && next_token(line, direction) && (direction == "vertical" || direction == "horizontal");
+            input.wall_orientation = (direction == "vertical") ? orientation::vertical : orientation::horizontal;
+        } else if (valid && action == "pause") {
+            input.action = scenario_action::pause;
+        } else if (valid && action == "quit") {
+            input.action = scenario_action::quit;
+        } else {
+            valid = false;
+        }
+        if (valid) { script.inputs.emplace_back(input); }
+
+    } else {
+        error = "unknown directive " + std::string(directive);
+        return false;
+    }
+
+    // nothing may follow the arguments
+    std::string_view extra;
+    if (!valid || next_token(line, extra)) { error = "invalid " + std::string(directive); return false; }
+    return true;
+}
+
+bool load_scenario(const std::string &filename, scenario &script, std::string &error) {
+    // read the file in fixed size chunks and parse lines in place, only lines split across chunks are copied
+    std::FILE* file = std::fopen(filename.c_str(), "rb");
+    if (file == NULL) { error = filename + ": could not open"; return false; }
+
+    std::vector<char> chunk(SCENARIO_CHUNK_SIZE);
+    std::string carry;
+    unsigned long line_number = 0;
+    bool parsed = true;
+
+    std::size_t bytes;
+    while (parsed && (bytes = std::fread(chunk.data(), 1, chunk.size(), file)) > 0) {
+        std::string_view remaining(chunk.data(), bytes);
+        std::size_t newline;
+        while (parsed && (newline = remaining.find('\n')) != std::string_view::npos) {
+            ++line_number;
+            if (carry.empty()) {
+                parsed = parse_scenario_line(remaining.substr(0, newline), script, error);
+            } else {
+                carry.append(remaining.data(), newline);
+                parsed = parse_scenario_line(carry, script, error);
+                carry.clear();
+            }
+            remaining.remove_prefix(newline + 1);
+        }
+        carry.append(remaining.data(), remaining.size());
+    }
+
+    // last line without a newline
+    if (parsed && !carry.empty()) {
+        ++line_number;
+        parsed = parse_scenario_line(carry, script, error);
+    }
+    if (parsed && script.version == 0) { error = "expected jezzball-scenario <version>"; parsed = false; }
+    std::fclose(file);
+
+    if (!parsed) { error = filename + ":" + std::to_string(line_number) + ": " + error; }
+    return parsed;
+}
+
+void apply_scenario(const scenario &script, simulation &sim) {
+    // replace the level in sim with the scenario
+    sim.game_state.current_level = script.level;
+    sim.game_state.current_lives = script.lives;
+    sim.game_state.current_percentage = 0;
+    sim.walls_list.clear();
+    for (std::vector<button> &row : sim.grid) {
+        for (button &cell : row) {
+            cell.reset();
+        }
+    }
+
+    // built walls
+    for (const scenario_wall &w : script.walls) {
+        button &cell = sim.grid[w.col][w.row];
+        if (cell.built) { continue; }
+        cell.active = true;
+        cell.built = true;
+        cell.colour = w.colour;
+        sim.walls_list.emplace_back(cell.hitbox, false, w.colour);
+    }
+
+    // captured regions, as fill_handle leaves them
+    for (const scenario_region &region : script.regions) {
+        for (int col = region.col_0; col <= region.col_1; ++col) {
+            for (int row = region.row_0; row <= region.row_1; ++row) {
+                button &cell = sim.grid[col][row];
+                if (cell.built) { continue; }
+                cell.active = true;
+                cell.built = true;
+                cell.filled = true;
+                cell.complete = true;
+                sim.walls_list.emplace_back(cell.hitbox, false, true);
+            }
+        }
+    }
+
+    // balls
+    sim.balls_list.clear();
+    sim.balls_list.reserve(script.balls.size());
+    for (const scenario_ball &b : script.balls) {
+        ball ball_tmp(0, 0, 0);
+        ball_tmp.set_speed(b.x_speed, b.y_speed);
+        ball_tmp.set_position(b.x, b.y);
+        sim.balls_list.emplace_back(ball_tmp);
+    }
+}
+
+bool scenario_input_pending(const scenario &script, std::size_t next_input) {
+    return next_input < script.inputs.size();
+}
+
+void scenario_input_handle(const scenario &script, std::size_t &next_input, simulation &sim, bool paused) {
+    // play scripted input due by the current frame
+    while (scenario_input_pending(script, next_input) && script.inputs[next_input].frame <= sim.game_state.frame) {
+        const scenario_input &input = script.inputs[next_input++];
+        switch (input.action) {
+            case scenario_action::place:
+                // ignored while paused, like a click
+                if (!paused) { place_wall(sim, input.col, input.row, input.wall_orientation); }
+                break;
+            case scenario_action::pause: {
+                // press escape
+                SDL_Event key{};
+                key.type = SDL_KEYDOWN;
+                key.key.keysym.sym = SDLK_ESCAPE;
+                SDL_PushEvent(&key);
+                break;
+            }
+            case scenario_action::quit:
+                sim.game_state.quit = true;
+                break;
+        }
+    }
+}
@@ -0,0 +1,214 @@
+#pragma once
+#include "SDL/SDL.h"
+#include <coroutine>
+#include <utility>
+#include <vector>
+
+// SCENES
+// the game is always in one scene, a coroutine that handles a frame and then waits for the next one
+// scenes and timed actions are resumed by the main loop, no other code runs frames of its own
+enum class scene : unsigned char {
+    playing,
+    paused,
+    level_complete,
+    won,
+    lost,
+    quit,
+};
+
+// timed actions waiting at once before waiting more allocates
+const std::size_t TIMED_ACTIONS_RESERVED = 16;
+
+class scene_task {
+    // coroutine run as a scene or as a timed action, it starts when awaited or spawned and returns the scene to go to next
+    public:
+        struct promise_type;
+        typedef std::coroutine_handle<promise_type> handle_type;
+
+        struct final_awaiter {
+            // hand control back to the coroutine awaiting this one, if any
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(handle_type finished) noexcept;
+            void await_resume() noexcept {}
+        };
+
+        struct promise_type {
+            scene next = scene::quit;
+            std::coroutine_handle<> continuation;
+
+            scene_task get_return_object() { return scene_task(handle_type::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            final_awaiter final_suspend() noexcept { return {}; }
+            void return_value(scene value) { next = value; }
+            void unhandled_exception() { throw; }
+        };
+
+        struct awaiter {
+            // run the task right away, the awaiting coroutine carries on once it returns
+            handle_type task;
+            bool await_ready() { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting);
+            scene await_resume();
+        };
+
+    private:
+        handle_type handle;
+
+    public:
+        scene_task();
+        explicit scene_task(handle_type h);
+        scene_task(scene_task &&other) noexcept;
+        scene_task &operator=(scene_task &&other) noexcept;
+        scene_task(const scene_task &) = delete;
+        scene_task &operator=(const scene_task &) = delete;
+        ~scene_task();
+
+        awaiter operator co_await();
+        bool is_done() const;
+        void resume();
+};
+
+class scene_scheduler {
+    // resumes timed actions once their time has come, then the scene waiting for the frame
+    private:
+        scene_task root;
+        scene current;
+
+        // coroutine waiting for the next frame, and whether nothing moves until an event arrives
+        std::coroutine_handle<> waiting;
+        bool idle;
+
+        struct timed_action {
+            std::coroutine_handle<> handle;
+            Uint32 due;
+        };
+        std::vector<timed_action> timed;
+
+        // spawned actions, owned until the scheduler stops
+        std::vector<scene_task> actions;
+
+    public:
+        struct frame_awaiter {
+            scene_scheduler &scenes;
+            bool idle;
+            bool await_ready() { return false; }
+            void await_suspend(std::coroutine_handle<> handle);
+            void await_resume() {}
+        };
+
+        struct delay_awaiter {
+            scene_scheduler &scenes;
+            Uint32 due;
+            bool await_ready() { return clock_ticks() >= due; }
+            void await_suspend(std::coroutine_handle<> handle);
+            void await_resume() {}
+        };
+
+        scene_scheduler();
+        ~scene_scheduler();
+
+        // run the task that picks the scenes until it first waits, and drop everything once done
+        void start(scene_task task);
+        void stop();
+        bool is_running() const;
+
+        // scene being run, set by the task picking scenes
+        void enter(scene next);
+        scene current_scene() const;
+
+        // true if the scene waits for an event and no timed action is pending
+        bool is_idle() const;
+
+        // one frame of timed actions and the scene
+        void run_frame();
+
+        // run a timed action alongside the scene until it first waits
+        void spawn(scene_task task);
+
+        // awaitables, the next frame, and the first frame after ms of game time
+        frame_awaiter next_frame(bool idle = false);
+        delay_awaiter wait(unsigned int ms);
+};
+
+// SCENE TASK CLASS
+std::coroutine_handle<> scene_task::final_awaiter::await_suspend(handle_type finished) noexcept {
+    const std::coroutine_handle<> continuation = finished.promise().continuation;
+    return continuation ? continuation : std::noop_coroutine();
+}
+std::coroutine_handle<> scene_task::awaiter::await_suspend(std::coroutine_handle<> awaiting) {
+    task.promise().continuation = awaiting;
+    return task;
+}
+scene scene_task::awaiter::await_resume() { return task.promise().next; }
+scene_task::scene_task() : handle(nullptr) {}
+scene_task::scene_task(handle_type h) : handle(h) {}
+scene_task::scene_task(scene_task &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+scene_task &scene_task::operator=(scene_task &&other) noexcept {
+    if (this != &other) {
+        if (handle) { handle.destroy(); }
+        handle = std::exchange(other.handle, nullptr);
+    }
+    return *this;
+}
+scene_task::~scene_task() {
+    if (handle) { handle.destroy(); }
+}
+scene_task::awaiter scene_task::operator co_await() { return awaiter{handle}; }
+bool scene_task::is_done() const { return !handle || handle.done(); }
+void scene_task::resume() {
+    if (!is_done()) { handle.resume(); }
+}
+
+// SCENE SCHEDULER CLASS
+void scene_scheduler::frame_awaiter::await_suspend(std::coroutine_handle<> handle) {
+    scenes.waiting = handle;
+    scenes.idle = idle;
+}
+void scene_scheduler::delay_awaiter::await_suspend(std::coroutine_handle<> handle) {
+    scenes.timed.emplace_back(timed_action{handle, due});
+}
+scene_scheduler::scene_scheduler() {
+    current = scene::playing;
+    waiting = nullptr;
+    idle = false;
+    timed.reserve(TIMED_ACTIONS_RESERVED);
+}
+scene_scheduler::~scene_scheduler() { stop(); }
+void scene_scheduler::start(scene_task task) {
+    root = std::move(task);
+    root.resume();
+}
+void scene_scheduler::stop() {
+    // suspended coroutines are destroyed, none of them runs again
+    waiting = nullptr;
+    timed.clear();
+    actions.clear();
+    root = scene_task();
+}
+bool scene_scheduler::is_running() const { return !root.is_done(); }
+void scene_scheduler::enter(scene next) { current = next; }
+scene scene_scheduler::current_scene() const { return current; }
+bool scene_scheduler::is_idle() const { return idle && timed.empty(); }
+void scene_scheduler::run_frame() {
+    trace_zone zone("scenes");
+
+    // timed actions first, so the scene sees what they changed
+    const Uint32 now = clock_ticks();
+    for (std::size_t n = 0; n < timed.size();) {
+        if (now >= timed[n].due) {
+            const std::coroutine_handle<> handle = timed[n].handle;
+            timed[n] = timed.back();
+            timed.pop_back();
+            handle.resume();
+        } else { ++n; }
+    }
+
+    const std::coroutine_handle<> handle = std::exchange(waiting, nullptr);
+    if (handle) { handle.resume(); }
+}
+void scene_scheduler::spawn(scene_task task) {
+    actions.emplace_back(std::move(task));
+    actions.back().resume();
+}
+scene_scheduler::frame_awaiter scene_scheduler::next_frame(bool idle) { return frame_awaiter{*this, idle}; }
+scene_scheduler::delay_awaiter scene_scheduler::wait(unsigned int ms) { return delay_awaiter{*this, clock_ticks() + ms}; }
@@ -0,0 +1,125 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+
+// DEFERRABLE TASKS
+enum task : int {
+    TASK_FILL,
+    TASK_RENDER,
+    TASK_CAPTION,
+    TASK_COUNT,
+};
+
+const char* task_names[TASK_COUNT] = {"fill", "render", "caption"};
+
+// frames a task can be put off before it runs regardless of the budget
+const int MAX_DEFERRED_FRAMES = 4;
+
+class frame_scheduler {
+    // runs deferrable tasks only while the frame has time left for them, critical work is never routed through here
+    private:
+        bool enabled;
+
+        // work time allowed per frame in microseconds, sleeping to cap fps does not count
+        long long budget;
+        std::chrono::steady_clock::time_point frame_start;
+
+        // task being timed
+        std::chrono::steady_clock::time_point task_start;
+
+        // smoothed cost of each task in microseconds
+        std::array<long long, TASK_COUNT> cost;
+
+        // frames each task has been deferred in a row
+        std::array<int, TASK_COUNT> waiting;
+
+        std::array<unsigned long, TASK_COUNT> runs;
+        std::array<unsigned long, TASK_COUNT> deferrals;
+        std::array<int, TASK_COUNT> longest_wait;
+        unsigned long frames;
+        unsigned long overruns;
+
+        long long elapsed() const;
+
+    public:
+        frame_scheduler();
+
+        // start scheduling with the given budget in milliseconds
+        void enable(int budget_ms);
+        bool is_enabled() const;
+
+        void begin_frame();
+
+        // true if the task fits in what is left of the frame, has waited too long, or is required this frame
+        // a task that is admitted is timed until done
+        bool admit(task t, bool required = false);
+        void done(task t);
+
+        // close the frame before sleeping
+        void end_frame();
+
+        // print runs and deferrals per task
+        void report(std::ostream &out) const;
+};
+
+frame_scheduler scheduler;
+
+// FRAME SCHEDULER CLASS
+frame_scheduler::frame_scheduler() {
+    enabled = false;
+    budget = 0;
+    cost.fill(0);
+    waiting.fill(0);
+    runs.fill(0);
+    deferrals.fill(0);
+    longest_wait.fill(0);
+    frames = 0;
+    overruns = 0;
+}
+long long frame_scheduler::elapsed() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - frame_start).count();
+}
+void frame_scheduler::enable(int budget_ms) {
+    enabled = true;
+    budget = budget_ms * 1000LL;
+    frame_start = std::chrono::steady_clock::now();
+}
+bool frame_scheduler::is_enabled() const { return enabled; }
+void frame_scheduler::begin_frame() {
+    if (enabled) { frame_start = std::chrono::steady_clock::now(); }
+}
+bool frame_scheduler::admit(task t, bool required) {
+    if (!enabled) { return true; }
+
+    // put off while the estimate does not fit
+    if (!required && waiting[t] < MAX_DEFERRED_FRAMES && elapsed() + cost[t] > budget) {
+        ++waiting[t];
+        ++deferrals[t];
+        longest_wait[t] = std::max(longest_wait[t], waiting[t]);
+        stats.add(TASKS_DEFERRED, 1);
+        return false;
+    }
+
+    waiting[t] = 0;
+    ++runs[t];
+    task_start = std::chrono::steady_clock::now();
+    return true;
+}
+void frame_scheduler::done(task t) {
+    if (!enabled) { return; }
+    const long long sample = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - task_start).count();
+    cost[t] = (3*cost[t] + sample) / 4;
+}
+void frame_scheduler::end_frame() {
+    if (!enabled) { return; }
+    ++frames;
+    if (elapsed() > budget) { ++overruns; }
+}
+void frame_scheduler::report(std::ostream &out) const {
+    out << "frame budget: " << budget / 1000 << " ms, " << overruns << " of " << frames << " frames over budget" << std::endl;
+    for (int t = 0; t < TASK_COUNT; ++t) {
+        out << "  " << std::left << std::setw(8) << task_names[t] << std::right << " ran " << runs[t] << ", deferred " << deferrals[t] << ", longest wait " << longest_wait[t] << " frames, cost " << cost[t] << " us" << std::endl;
+    }
+}
@@ -0,0 +1,226 @@
+#pragma once
+#include <vector>
+#include <array>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <iomanip>
+#include <fcntl.h>
+#include <unistd.h>
+
+// SOAK TEST
+// what -autoplay watches over a long unattended run, logged every report interval and summed up on exit
+enum soak_anomaly : int {
+    SOAK_ESCAPED,
+    SOAK_CAPTURED,
+    SOAK_OVER_BUDGET,
+    SOAK_MEMORY_GROWTH,
+    SOAK_ANOMALY_COUNT,
+};
+
+const char* soak_anomaly_names[SOAK_ANOMALY_COUNT] = {"ball left the playfield", "ball inside a captured cell", "frame over budget", "memory growth"};
+
+// anomalies printed per report interval, the rest are only counted
+const int SOAK_LOGGED_PER_REPORT = 8;
+
+// frames after start up before frame times count against the budget
+const unsigned long SOAK_WARMUP_FRAMES = FPS_CAP;
+
+// resident memory growth in kilobytes over the last flagged size that counts as memory growth
+const long SOAK_RSS_SLACK_KB = 16384;
+
+// pixels a ball may overlap the playfield border by
+const float SOAK_ESCAPE_SLACK = 1.0f;
+
+long resident_kilobytes() {
+    // resident set size from /proc, -1 where there is none, read without allocating
+    const int fd = ::open("/proc/self/statm", O_RDONLY);
+    if (fd < 0) { return -1; }
+    char buffer[128];
+    const ssize_t length = ::read(fd, buffer, sizeof(buffer) - 1);
+    ::close(fd);
+    if (length <= 0) { return -1; }
+    buffer[length] = '\0';
+    unsigned long pages, resident;
+    if (std::sscanf(buffer, "%lu %lu", &pages, &resident) != 2) { return -1; }
+    return long(resident) * (::sysconf(_SC_PAGESIZE) / 1024);
+}
+
+class soak_monitor {
+    private:
+        bool enabled;
+
+        // frames between reports, and work time allowed per frame in microseconds
+        unsigned long interval;
+        long long budget;
+
+        // work times of the frames since the last report in microseconds, reserved for a full interval
+        std::vector<long long> frame_times;
+        std::chrono::steady_clock::time_point frame_start;
+
+        // heap allocations since the last report, and in steady state frames
+        unsigned long interval_allocations;
+        unsigned long interval_steady_allocations;
+
+        std::array<unsigned long, SOAK_ANOMALY_COUNT> anomalies;
+        int interval_logged;
+
+        // resident memory at the first report, raised each time growth is flagged
+        long baseline_rss;
+
+        unsigned long levels;
+        unsigned long games;
+        unsigned long frames;
+
+        // count an anomaly and print it unless enough were printed this interval
+        void flag(soak_anomaly kind, unsigned long frame, std::size_t ball_index, float x, float y);
+
+        // check balls against the playfield and the captured cells
+        void check_balls(const simulation &sim);
+
+        void log(unsigned long frame);
+
+    public:
+        soak_monitor();
+
+        // start logging every report_frames frames, frames over budget_ms are flagged
+        void enable(unsigned long report_frames, int budget_ms);
+        bool is_enabled() const;
+
+        void begin_frame();
+
+        // close the frame before sleeping, and log if the interval is over
+        void end_frame(const simulation &sim, bool steady);
+
+        // levels completed and games ended, counted by the autoplay agent
+        void count_level();
+        void count_game();
+
+        // no anomaly was flagged
+        bool passed() const;
+
+        // print totals
+        void report(std::ostream &out) const;
+};
+
+soak_monitor soak;
+
+// SOAK MONITOR CLASS
+soak_monitor::soak_monitor() {
+    enabled = false;
+    interval = 0;
+    budget = 0;
+    interval_allocations = 0;
+    interval_steady_allocations = 0;
+    anomalies.fill(0);
+    interval_logged = 0;
+    baseline_rss = -1;
+    levels = 0;
+    games = 0;
+    frames = 0;
+}
+void soak_monitor::enable(unsigned long report_frames, int budget_ms) {
+    enabled = true;
+    interval = report_frames;
+    budget = 1000LL * budget_ms;
+    frame_times.reserve(interval);
+}
+bool soak_monitor::is_enabled() const { return enabled; }
+void soak_monitor::begin_frame() {
+    if (!enabled) { return; }
+    frame_start = std::chrono::steady_clock::now();
+}
+void soak_monitor::end_frame(const simulation &sim, bool steady) {
+    if (!enabled) { return; }
+    const long long elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - frame_start).count();
+    ++frames;
+    frame_times.push_back(elapsed);
+    if (frames > SOAK_WARMUP_FRAMES && elapsed > budget) { flag(SOAK_OVER_BUDGET, sim.game_state.frame, 0, elapsed / 1000.0f, budget / 1000.0f); }
+
+    const unsigned long allocated = stats.last_frame()[HEAP_ALLOCATIONS];
+    interval_allocations += allocated;
+    if (steady) { interval_steady_allocations += allocated; }
+
+    check_balls(sim);
+    if (frame_times.size() >= interval) { log(sim.game_state.frame); }
+}
+void soak_monitor::check_balls(const simulation &sim) {
+    const float left = GRID_X_OFFSET - SOAK_ESCAPE_SLACK;
+    const float top = GRID_Y_OFFSET - SOAK_ESCAPE_SLACK;
+    const float right = GRID_X_OFFSET + float(sim.grid.size() * GRID_DIM) + SOAK_ESCAPE_SLACK;
+    const float bottom = GRID_Y_OFFSET + float(sim.grid[0].size() * GRID_DIM) + SOAK_ESCAPE_SLACK;
+    for (std::size_t n = 0; n < sim.balls_list.size(); ++n) {
+        const ball &b = sim.balls_list[n];
+
+        // outside the border, or not a position at all
+        if (!std::isfinite(b.x_pos) || !std::isfinite(b.y_pos) || b.x_pos < left || b.y_pos < top || b.x_pos + b.rad > right || b.y_pos + b.rad > bottom) {
+            flag(SOAK_ESCAPED, sim.game_state.frame, n, b.x_pos, b.y_pos);
+            continue;
+        }
+
+        // centre in a captured region, walls are left out since a ball breaking one overlaps it until the wall is removed
+        const int col = int(b.x_pos + b.rad / 2.0f - GRID_X_OFFSET) / GRID_DIM;
+        const int row = int(b.y_pos + b.rad / 2.0f - GRID_Y_OFFSET) / GRID_DIM;
+        if (col >= 0 && row >= 0 && col < int(sim.grid.size()) && row < int(sim.grid[0].size()) && sim.grid[col][row].complete) {
+            flag(SOAK_CAPTURED, sim.game_state.frame, n, b.x_pos, b.y_pos);
+        }
+    }
+}
+void soak_monitor::flag(soak_anomaly kind, unsigned long frame, std::size_t ball_index, float x, float y) {
+    ++anomalies[kind];
+    if (interval_logged++ >= SOAK_LOGGED_PER_REPORT) { return; }
+    std::cout << "autoplay: frame " << frame << ": " << soak_anomaly_names[kind];
+    switch (kind) {
+        case SOAK_ESCAPED: case SOAK_CAPTURED: std::cout << ", ball " << ball_index << " at " << x << ", " << y; break;
+        case SOAK_OVER_BUDGET: std::cout << ", " << x << " ms of " << y << " ms"; break;
+        case SOAK_MEMORY_GROWTH: std::cout << ", " << long(x) << " kB resident from " << long(y) << " kB"; break;
+        default: break;
+    }
+    std::cout << std::endl;
+}
+void soak_monitor::log(unsigned long frame) {
+    // frame time percentiles of the interval, partitioning the samples in place
+    const std::size_t count = frame_times.size();
+    const auto percentile = [this, count](std::size_t p) {
+        const std::size_t n = std::min(count - 1, count * p / 100);
+        std::nth_element(frame_times.begin(), frame_times.begin() + n, frame_times.end());
+        return frame_times[n] / 1000.0;
+    };
+    const double p50 = percentile(50);
+    const double p95 = percentile(95);
+    const double p99 = percentile(99);
+    const double worst = *std::max_element(frame_times.begin(), frame_times.end()) / 1000.0;
+
+    // resident memory against the first report
+    const long rss = resident_kilobytes();
+    if (baseline_rss < 0) { baseline_rss = rss; }
+    if (rss >= 0 && rss > baseline_rss + SOAK_RSS_SLACK_KB) {
+        flag(SOAK_MEMORY_GROWTH, frame, 0, float(rss), float(baseline_rss));
+        baseline_rss = rss;
+    }
+
+    unsigned long flagged = 0;
+    for (unsigned long count : anomalies) { flagged += count; }
+    std::cout << "autoplay: frame " << frame << ", " << levels << " levels, " << games << " games, frame time" << std::fixed << std::setprecision(2) << " p50 " << p50 << " p95 " << p95 << " p99 " << p99 << " max " << worst << " ms" << std::defaultfloat << std::setprecision(6) << ", " << rss << " kB resident, " << interval_allocations << " allocations (" << interval_steady_allocations << " in steady frames), " << flagged << " anomalies" << std::endl;
+
+    frame_times.clear();
+    interval_allocations = 0;
+    interval_steady_allocations = 0;
+    interval_logged = 0;
+}
+void soak_monitor::count_level() { ++levels; }
+void soak_monitor::count_game() { ++games; }
+bool soak_monitor::passed() const {
+    for (unsigned long count : anomalies) {
+        if (count > 0) { return false; }
+    }
+    return true;
+}
+void soak_monitor::report(std::ostream &out) const {
+    out << "autoplay: " << frames << " frames, " << levels << " levels completed, " << games << " games played" << std::endl;
+    for (int kind = 0; kind < SOAK_ANOMALY_COUNT; ++kind) {
+        out << "  " << std::left << std::setw(28) << soak_anomaly_names[kind] << std::right << std::setw(10) << anomalies[kind] << std::endl;
+    }
+}
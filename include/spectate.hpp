@@ -0,0 +1,380 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// SPECTATOR FEED
+// every frame is published into a ring of slots in posix shared memory, one writer and any number of readers
+//     header    magic version live columns rows cell_pixels ball_pixels slots max_balls slot_bytes published
+//     slot      sequence frame level lives percentage status balls changed, then cells(u8) per cell, changed cells(u16), balls x y (i16)
+// a slot's sequence is odd while the writer fills it and even once done, readers copy a slot and check the sequence did not move
+// so the writer never waits on a reader, and a reader that falls a ring behind skips ahead to the latest frame
+// cells are col * rows + row, changed lists the cells that differ from the frame before
+// balls are the top left of the ball in pixels from the top left of the board
+// this header stands alone so spectator tools can include it without the game
+const std::uint32_t SPECTATE_MAGIC = 0x4a5a4246;
+const std::uint32_t SPECTATE_VERSION = 1;
+
+// frames held, a reader has this many frames of time to copy one
+const std::uint32_t SPECTATE_SLOTS = 8;
+
+// copies a reader tries before giving up until the next read
+const int SPECTATE_READ_ATTEMPTS = 4;
+
+// what a cell holds
+const std::uint8_t SPECTATE_OPEN = 0;
+const std::uint8_t SPECTATE_WHITE = 1;
+const std::uint8_t SPECTATE_BLACK = 2;
+
+enum class spectator_status : std::uint8_t {
+    playing,
+    paused,
+    level_complete,
+    won,
+    lost,
+};
+
+inline constexpr const char* spectator_status_names[] = {"playing", "paused", "complete", "won", "lost"};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "the feed needs lock free atomics to share them across processes");
+
+struct spectator_header {
+    std::atomic<std::uint32_t> magic;
+    std::uint32_t version;
+
+    // cleared when the game closes the feed
+    std::atomic<std::uint32_t> live;
+
+    std::uint32_t columns, rows;
+    std::uint32_t cell_pixels, ball_pixels;
+    std::uint32_t slots, max_balls;
+    std::uint64_t slot_bytes;
+
+    // frames published, the latest is in slot (published - 1) % slots
+    std::atomic<std::uint64_t> published;
+};
+
+struct spectator_slot {
+    // 2 * tick + 1 while being written, 2 * tick + 2 once complete
+    std::atomic<std::uint64_t> sequence;
+
+    std::uint64_t frame;
+    std::uint32_t level;
+    std::uint32_t lives;
+    float percentage;
+    std::uint8_t status;
+    std::uint8_t padding[3];
+    std::uint32_t balls;
+    std::uint32_t changed;
+};
+
+struct spectator_hud {
+    // what the game shows besides the board
+    std::uint64_t frame;
+    std::uint32_t level;
+    std::uint32_t lives;
+    float percentage;
+    spectator_status status;
+};
+
+struct spectator_frame {
+    // a copy of one published frame
+    std::uint64_t tick = 0;
+
+    // ticks missed since the frame read before, or before the first one read, changed only adds up to the board while this is 0
+    std::uint64_t skipped = 0;
+
+    spectator_hud hud{};
+    std::uint32_t columns = 0, rows = 0;
+    std::uint32_t cell_pixels = 0, ball_pixels = 0;
+    std::vector<std::uint8_t> cells;
+    std::vector<std::uint16_t> changed;
+    std::vector<std::pair<std::int16_t, std::int16_t>> balls;
+};
+
+struct spectator_layout {
+    // byte offsets of a slot's cells, changed cells and balls, and its size
+    std::size_t cells, changed, balls, bytes;
+};
+
+inline spectator_layout spectate_layout(std::size_t cells, std::size_t max_balls) {
+    spectator_layout layout;
+    layout.cells = sizeof(spectator_slot);
+    layout.changed = layout.cells + ((cells + 1) & ~std::size_t(1));
+    layout.balls = layout.changed + 2 * cells;
+
+    // slots are 8 byte aligned so every sequence can be read atomically
+    layout.bytes = (layout.balls + 4 * max_balls + 7) & ~std::size_t(7);
+    return layout;
+}
+
+inline std::string spectate_name(const std::string &name) {
+    // shared memory names start with a slash
+    return (!name.empty() && name[0] == '/') ? name : "/" + name;
+}
+
+class spectator_feed {
+    // writer side, owned by the game
+    private:
+        std::string name;
+        std::uint8_t* memory;
+        std::size_t size;
+        spectator_header* header;
+        spectator_layout layout;
+
+        // board published last and the one being filled
+        std::vector<std::uint8_t> board, next_board;
+
+        // slot being filled
+        spectator_slot* slot;
+        std::uint64_t tick;
+
+        spectator_slot* slot_at(std::uint64_t n);
+
+    public:
+        spectator_feed();
+        ~spectator_feed();
+
+        // create the shared memory for a board of columns by rows cells and up to max_balls balls
+        bool open(const std::string &where, std::uint32_t columns, std::uint32_t rows, std::uint32_t cell_pixels, std::uint32_t ball_pixels, std::uint32_t max_balls);
+        void close();
+        bool is_open() const;
+
+        // start the next frame, the board is cleared to open cells to be filled in
+        void begin();
+        std::uint8_t* cells();
+
+        // room for the x and y of count balls, count is clamped to max_balls
+        std::int16_t* balls(std::size_t &count);
+
+        // make the frame visible to readers
+        void publish(const spectator_hud &hud);
+};
+
+class spectator_reader {
+    // reader side, never writes to the shared memory
+    private:
+        const std::uint8_t* memory;
+        std::size_t size;
+        const spectator_header* header;
+        spectator_layout layout;
+
+        // tick read last, and whether any was
+        std::uint64_t last;
+        bool started;
+
+        const spectator_slot* slot_at(std::uint64_t n) const;
+        bool copy(std::uint64_t n, spectator_frame &frame) const;
+
+    public:
+        spectator_reader();
+        ~spectator_reader();
+
+        bool open(const std::string &where);
+        void close();
+
+        // true until the game closes the feed
+        bool is_live() const;
+
+        // copy the frame after the one read last, or the latest if that one is gone, false if there is no newer frame yet
+        bool read(spectator_frame &frame);
+};
+
+// SPECTATOR FEED CLASS
+inline spectator_feed::spectator_feed() {
+    memory = NULL;
+    size = 0;
+    header = NULL;
+    slot = NULL;
+    tick = 0;
+}
+inline spectator_feed::~spectator_feed() { close(); }
+inline spectator_slot* spectator_feed::slot_at(std::uint64_t n) {
+    return reinterpret_cast<spectator_slot*>(memory + sizeof(spectator_header) + (n % header->slots) * header->slot_bytes);
+}
+inline bool spectator_feed::open(const std::string &where, std::uint32_t columns, std::uint32_t rows, std::uint32_t cell_pixels, std::uint32_t ball_pixels, std::uint32_t max_balls) {
+    name = spectate_name(where);
+    layout = spectate_layout(columns * rows, max_balls);
+    size = sizeof(spectator_header) + SPECTATE_SLOTS * layout.bytes;
+
+    const int fd = ::shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd == -1) { return false; }
+    if (::ftruncate(fd, size) == -1) {
+        ::close(fd);
+        ::shm_unlink(name.c_str());
+        return false;
+    }
+    void* mapped = ::mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        ::shm_unlink(name.c_str());
+        return false;
+    }
+    memory = static_cast<std::uint8_t*>(mapped);
+
+    // the magic goes in last, readers opening before then see no feed
+    header = new (memory) spectator_header{};
+    header->version = SPECTATE_VERSION;
+    header->columns = columns;
+    header->rows = rows;
+    header->cell_pixels = cell_pixels;
+    header->ball_pixels = ball_pixels;
+    header->slots = SPECTATE_SLOTS;
+    header->max_balls = max_balls;
+    header->slot_bytes = layout.bytes;
+    for (std::uint32_t n = 0; n < SPECTATE_SLOTS; ++n) { new (slot_at(n)) spectator_slot{}; }
+    header->live.store(1, std::memory_order_relaxed);
+    header->magic.store(SPECTATE_MAGIC, std::memory_order_release);
+
+    board.assign(columns * rows, SPECTATE_OPEN);
+    next_board.assign(columns * rows, SPECTATE_OPEN);
+    tick = 0;
+    return true;
+}
+inline void spectator_feed::close() {
+    if (memory == NULL) { return; }
+    // readers still mapping the feed see it end
+    header->live.store(0, std::memory_order_release);
+    ::munmap(memory, size);
+    ::shm_unlink(name.c_str());
+    memory = NULL;
+    header = NULL;
+    slot = NULL;
+}
+inline bool spectator_feed::is_open() const { return memory != NULL; }
+inline void spectator_feed::begin() {
+    slot = slot_at(tick);
+    slot->sequence.store(2 * tick + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::fill(next_board.begin(), next_board.end(), SPECTATE_OPEN);
+}
+inline std::uint8_t* spectator_feed::cells() { return next_board.data(); }
+inline std::int16_t* spectator_feed::balls(std::size_t &count) {
+    count = std::min<std::size_t>(count, header->max_balls);
+    slot->balls = count;
+    return reinterpret_cast<std::int16_t*>(reinterpret_cast<std::uint8_t*>(slot) + layout.balls);
+}
+inline void spectator_feed::publish(const spectator_hud &hud) {
+    slot->frame = hud.frame;
+    slot->level = hud.level;
+    slot->lives = hud.lives;
+    slot->percentage = hud.percentage;
+    slot->status = static_cast<std::uint8_t>(hud.status);
+
+    // the board, and the cells that changed since the last frame
+    std::uint8_t* cells = reinterpret_cast<std::uint8_t*>(slot) + layout.cells;
+    std::uint16_t* changed = reinterpret_cast<std::uint16_t*>(reinterpret_cast<std::uint8_t*>(slot) + layout.changed);
+    std::memcpy(cells, next_board.data(), board.size());
+    std::uint32_t count = 0;
+    for (std::size_t n = 0; n < board.size(); ++n) {
+        if (next_board[n] != board[n]) { changed[count++] = n; }
+    }
+    slot->changed = count;
+    board.swap(next_board);
+
+    slot->sequence.store(2 * tick + 2, std::memory_order_release);
+    header->published.store(++tick, std::memory_order_release);
+}
+
+// SPECTATOR READER CLASS
+inline spectator_reader::spectator_reader() {
+    memory = NULL;
+    size = 0;
+    header = NULL;
+    last = 0;
+    started = false;
+}
+inline spectator_reader::~spectator_reader() { close(); }
+inline const spectator_slot* spectator_reader::slot_at(std::uint64_t n) const {
+    return reinterpret_cast<const spectator_slot*>(memory + sizeof(spectator_header) + (n % header->slots) * header->slot_bytes);
+}
+inline bool spectator_reader::open(const std::string &where) {
+    const std::string name = spectate_name(where);
+    const int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd == -1) { return false; }
+    struct stat info;
+    if (::fstat(fd, &info) == -1 || std::size_t(info.st_size) < sizeof(spectator_header)) {
+        ::close(fd);
+        return false;
+    }
+    void* mapped = ::mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) { return false; }
+    memory = static_cast<const std::uint8_t*>(mapped);
+    size = info.st_size;
+    header = reinterpret_cast<const spectator_header*>(memory);
+
+    // a feed still being set up, from another version, or cut short is refused
+    const bool valid = (header->magic.load(std::memory_order_acquire) == SPECTATE_MAGIC) && (header->version == SPECTATE_VERSION) && (header->slots > 0)
+        && (header->slot_bytes == spectate_layout(header->columns * header->rows, header->max_balls).bytes)
+        && (size >= sizeof(spectator_header) + header->slots * header->slot_bytes);
+    if (!valid) {
+        close();
+        return false;
+    }
+    layout = spectate_layout(header->columns * header->rows, header->max_balls);
+    started = false;
+    return true;
+}
+inline void spectator_reader::close() {
+    if (memory == NULL) { return; }
+    ::munmap(const_cast<std::uint8_t*>(memory), size);
+    memory = NULL;
+    header = NULL;
+}
+inline bool spectator_reader::is_live() const { return header != NULL && header->live.load(std::memory_order_acquire) != 0; }
+inline bool spectator_reader::copy(std::uint64_t n, spectator_frame &frame) const {
+    // false if the slot no longer holds tick n or the writer moved on while copying
+    const spectator_slot* slot = slot_at(n);
+    const std::uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+    if (sequence != 2 * n + 2) { return false; }
+
+    const std::size_t cells = header->columns * header->rows;
+    const std::uint8_t* start = reinterpret_cast<const std::uint8_t*>(slot);
+    const std::uint8_t* board = start + layout.cells;
+    const std::uint16_t* changed = reinterpret_cast<const std::uint16_t*>(start + layout.changed);
+    const std::int16_t* balls = reinterpret_cast<const std::int16_t*>(start + layout.balls);
+    const std::uint32_t ball_count = std::min(slot->balls, header->max_balls);
+    const std::uint32_t changed_count = std::min<std::uint32_t>(slot->changed, cells);
+
+    frame.tick = n;
+    frame.hud = spectator_hud{slot->frame, slot->level, slot->lives, slot->percentage, static_cast<spectator_status>(slot->status)};
+    frame.columns = header->columns;
+    frame.rows = header->rows;
+    frame.cell_pixels = header->cell_pixels;
+    frame.ball_pixels = header->ball_pixels;
+    frame.cells.assign(board, board + cells);
+    frame.changed.assign(changed, changed + changed_count);
+    frame.balls.resize(ball_count);
+    for (std::uint32_t b = 0; b < ball_count; ++b) { frame.balls[b] = {balls[2 * b], balls[2 * b + 1]}; }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot->sequence.load(std::memory_order_relaxed) == sequence;
+}
+inline bool spectator_reader::read(spectator_frame &frame) {
+    if (header == NULL) { return false; }
+    for (int attempt = 0; attempt < SPECTATE_READ_ATTEMPTS; ++attempt) {
+        const std::uint64_t published = header->published.load(std::memory_order_acquire);
+        if (published == 0 || (started && last + 1 >= published)) { return false; }
+
+        // follow on from the last frame while the writer is not about to reuse its slot, else jump to the latest
+        std::uint64_t n = published - 1;
+        if (started && last + 1 < published && published - (last + 1) < header->slots - 1) { n = last + 1; }
+        if (copy(n, frame)) {
+            frame.skipped = started ? n - last - 1 : n;
+            last = n;
+            started = true;
+            return true;
+        }
+    }
+    return false;
+}
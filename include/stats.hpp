@@ -0,0 +1,211 @@
+#pragma once
+#include <atomic>
+#include <array>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <bit>
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <iostream>
+#include <iomanip>
+
+// ENGINE COUNTERS
+enum counter : int {
+    COLLISION_RECT_TESTS,
+    COLLISION_BUTTON_TESTS,
+    COLLISION_WALL_TESTS,
+    FILL_CELLS_VISITED,
+    WALLS_BLITTED,
+    PENDING_SEGMENTS,
+    BALLS_UPDATED,
+    KINETIC_EVENTS,
+    TASKS_DEFERRED,
+    HEAP_ALLOCATIONS,
+    HEAP_BYTES,
+    SCALED_PIXELS,
+    COUNTER_COUNT,
+};
+
+// names used in the json export and on the overlay
+const char* counter_names[COUNTER_COUNT] = {"collision_rect_tests", "collision_button_tests", "collision_wall_tests", "fill_cells_visited", "walls_blitted", "pending_segments", "balls_updated", "kinetic_events", "tasks_deferred", "heap_allocations", "heap_bytes", "scaled_pixels"};
+const char* counter_labels[COUNTER_COUNT] = {"RECT TESTS", "BUTTON TESTS", "WALL TESTS", "FILL CELLS", "WALLS BLITTED", "PENDING WALLS", "BALLS UPDATED", "KINETIC EVENTS", "TASKS DEFERRED", "ALLOCATIONS", "ALLOCATED BYTES", "SCALED PIXELS"};
+
+// power of two buckets, bucket n holds values in [2^(n-1), 2^n), the last bucket holds everything larger
+const int HISTOGRAM_BUCKETS = 33;
+
+typedef std::array<unsigned long, COUNTER_COUNT> counter_sample;
+
+class engine_stats {
+    private:
+        // counts for the frame in progress, written by the simulation and render threads
+        std::array<std::atomic<unsigned long>, COUNTER_COUNT> current;
+
+        // counts for the last completed frame
+        counter_sample last;
+
+        // per-frame samples, only kept when exporting
+        std::vector<counter_sample> samples;
+        bool recording;
+
+        std::array<std::array<unsigned long, HISTOGRAM_BUCKETS>, COUNTER_COUNT> histograms;
+        counter_sample totals;
+        unsigned long frames;
+
+    public:
+        engine_stats();
+
+        // count work in the current frame
+        void add(counter c, unsigned long n);
+
+        // close the current frame
+        void end_frame();
+
+        // keep every frame for export, reserving room for the expected number of frames
+        void record(std::size_t expected_frames);
+
+        const counter_sample &last_frame() const;
+
+        // write samples, histograms and totals as json
+        bool write_json(const std::string &filename) const;
+};
+
+engine_stats stats;
+
+// ENGINE STATS CLASS
+engine_stats::engine_stats() {
+    for (std::atomic<unsigned long> &count : current) { count = 0; }
+    last.fill(0);
+    recording = false;
+    for (std::array<unsigned long, HISTOGRAM_BUCKETS> &histogram : histograms) { histogram.fill(0); }
+    totals.fill(0);
+    frames = 0;
+}
+void engine_stats::add(counter c, unsigned long n) {
+    current[c].fetch_add(n, std::memory_order_relaxed);
+}
+void engine_stats::end_frame() {
+    // heap use since the previous frame, on any thread
+    add(HEAP_ALLOCATIONS, heap_allocations.exchange(0, std::memory_order_relaxed));
+    add(HEAP_BYTES, heap_bytes.exchange(0, std::memory_order_relaxed));
+
+    for (int c = 0; c < COUNTER_COUNT; ++c) {
+        last[c] = current[c].exchange(0, std::memory_order_relaxed);
+        totals[c] += last[c];
+        ++histograms[c][std::min<int>(std::bit_width(last[c]), HISTOGRAM_BUCKETS - 1)];
+    }
+    ++frames;
+    if (recording) { samples.emplace_back(last); }
+}
+void engine_stats::record(std::size_t expected_frames) {
+    recording = true;
+    samples.reserve(expected_frames);
+}
+const counter_sample &engine_stats::last_frame() const { return last; }
+bool engine_stats::write_json(const std::string &filename) const {
+    std::ofstream file(filename);
+    if (!file) { return false; }
+
+    file << "{\n  \"frames\": " << frames << ",\n";
+
+    // counter names in sample order
+    file << "  \"counters\": [";
+    for (int c = 0; c < COUNTER_COUNT; ++c) { file << (c ? ", " : "") << '"' << counter_names[c] << '"'; }
+    file << "],\n";
+
+    // totals
+    file << "  \"totals\": {";
+    for (int c = 0; c < COUNTER_COUNT; ++c) { file << (c ? ", " : "") << '"' << counter_names[c] << "\": " << totals[c]; }
+    file << "},\n";
+
+    // histograms, bucket n counts frames with a value below 2^n and at least 2^(n-1)
+    file << "  \"histograms\": {\n";
+    for (int c = 0; c < COUNTER_COUNT; ++c) {
+        file << "    \"" << counter_names[c] << "\": [";
+        for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; ++bucket) { file << (bucket ? ", " : "") << histograms[c][bucket]; }
+        file << "]" << (c + 1 < COUNTER_COUNT ? "," : "") << "\n";
+    }
+    file << "  },\n";
+
+    // per-frame samples
+    file << "  \"samples\": [\n";
+    for (std::vector<counter_sample>::size_type n = 0; n < samples.size(); ++n) {
+        file << "    [";
+        for (int c = 0; c < COUNTER_COUNT; ++c) { file << (c ? ", " : "") << samples[n][c]; }
+        file << "]" << (n + 1 < samples.size() ? "," : "") << "\n";
+    }
+    file << "  ]\n}\n";
+
+    return bool(file);
+}
+
+// CPU USAGE
+enum activity : int {
+    ACTIVITY_RUNNING,
+    ACTIVITY_IDLE,
+    ACTIVITY_ENDGAME,
+    ACTIVITY_COUNT,
+};
+
+const char* activity_labels[ACTIVITY_COUNT] = {"running", "paused", "endgame"};
+
+class cpu_meter {
+    // process cpu time against wall time, split by what the game loop was doing
+    private:
+        bool enabled;
+        activity current;
+        std::clock_t cpu_start;
+        std::chrono::steady_clock::time_point wall_start;
+
+        std::array<double, ACTIVITY_COUNT> cpu_seconds;
+        std::array<double, ACTIVITY_COUNT> wall_seconds;
+
+    public:
+        cpu_meter();
+
+        // start measuring
+        void enable();
+
+        // charge time since the last call to the current activity, then switch to the given one
+        void enter(activity next);
+
+        // print cpu usage per activity as a percentage of one core
+        void report(std::ostream &out);
+};
+
+cpu_meter cpu;
+
+// CPU METER CLASS
+cpu_meter::cpu_meter() {
+    enabled = false;
+    current = ACTIVITY_RUNNING;
+    cpu_start = 0;
+    cpu_seconds.fill(0);
+    wall_seconds.fill(0);
+}
+void cpu_meter::enable() {
+    enabled = true;
+    cpu_start = std::clock();
+    wall_start = std::chrono::steady_clock::now();
+}
+void cpu_meter::enter(activity next) {
+    if (!enabled) { return; }
+    const std::clock_t cpu_now = std::clock();
+    const std::chrono::steady_clock::time_point wall_now = std::chrono::steady_clock::now();
+    cpu_seconds[current] += double(cpu_now - cpu_start) / CLOCKS_PER_SEC;
+    wall_seconds[current] += std::chrono::duration<double>(wall_now - wall_start).count();
+    cpu_start = cpu_now;
+    wall_start = wall_now;
+    current = next;
+}
+void cpu_meter::report(std::ostream &out) {
+    // close the activity in progress
+    enter(current);
+    out << "cpu usage:" << std::endl;
+    for (int a = 0; a < ACTIVITY_COUNT; ++a) {
+        const double usage = (wall_seconds[a] > 0) ? 100.0 * cpu_seconds[a] / wall_seconds[a] : 0.0;
+        out << "  " << std::left << std::setw(8) << activity_labels[a] << std::right << std::fixed << std::setprecision(1) << std::setw(6) << usage << "% over " << std::setprecision(2) << wall_seconds[a] << " s" << std::endl;
+    }
+    out << std::defaultfloat;
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include <chrono>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <mutex>
+#include <atomic>
+
+// TRACE EVENTS
+struct trace_event {
+    // zone name, must outlive the tracer
+    const char* name;
+
+    // start and duration in microseconds since tracing started
+    long long start;
+    long long duration;
+
+    int thread;
+};
+
+class tracer {
+    private:
+        bool enabled;
+        std::chrono::steady_clock::time_point origin;
+
+        std::mutex events_mutex;
+        std::vector<trace_event> events;
+
+        // small ids handed out to threads as they record their first zone
+        std::atomic<int> next_thread;
+
+    public:
+        tracer();
+
+        // start recording zones
+        void enable();
+        bool is_enabled() const;
+
+        // microseconds since tracing started
+        long long now() const;
+
+        // id of the calling thread
+        int thread_id();
+
+        void record(const char* name, long long start, long long duration);
+
+        // write recorded zones in chrome trace event format
+        bool write_json(const std::string &filename);
+};
+
+tracer trace;
+
+class trace_zone {
+    // records the lifetime of the zone when tracing is enabled, costs one branch otherwise
+    private:
+        const char* name;
+        long long start;
+        bool open;
+
+        // allocations made by this thread when the zone opened
+        unsigned long allocations_start;
+        unsigned long bytes_start;
+        bool counting;
+
+    public:
+        explicit trace_zone(const char* name);
+        ~trace_zone();
+
+        // close the zone before the end of its scope
+        void end();
+
+        trace_zone(const trace_zone&) = delete;
+        trace_zone& operator=(const trace_zone&) = delete;
+};
+
+// TRACER CLASS
+tracer::tracer() {
+    enabled = false;
+    next_thread = 0;
+}
+void tracer::enable() {
+    origin = std::chrono::steady_clock::now();
+    events.reserve(1 << 16);
+    enabled = true;
+}
+bool tracer::is_enabled() const { return enabled; }
+long long tracer::now() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+int tracer::thread_id() {
+    thread_local int id = next_thread++;
+    return id;
+}
+void tracer::record(const char* name, long long start, long long duration) {
+    const int thread = thread_id();
+    std::lock_guard<std::mutex> lock(events_mutex);
+    events.push_back(trace_event{name, start, duration, thread});
+}
+bool tracer::write_json(const std::string &filename) {
+    std::ofstream file(filename);
+    if (!file) { return false; }
+
+    std::lock_guard<std::mutex> lock(events_mutex);
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    file << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"JezzBall\"}}";
+    for (const trace_event &current_event : events) {
+        file << ",\n{\"name\": \"" << current_event.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << current_event.thread << ", \"ts\": " << current_event.start << ", \"dur\": " << current_event.duration << "}";
+    }
+    file << "\n]}\n";
+
+    return bool(file);
+}
+
+// TRACE ZONE CLASS
+trace_zone::trace_zone(const char* name) {
+    this->name = name;
+    open = trace.is_enabled();
+    start = open ? trace.now() : 0;
+    counting = allocations.is_enabled();
+    allocations_start = thread_allocations;
+    bytes_start = thread_bytes;
+}
+trace_zone::~trace_zone() { end(); }
+void trace_zone::end() {
+    // count allocations before recording the zone, so trace storage growing is not charged to it
+    if (counting) {
+        allocations.record_phase(name, thread_allocations - allocations_start, thread_bytes - bytes_start);
+        counting = false;
+    }
+    if (open) {
+        trace.record(name, start, trace.now() - start);
+        open = false;
+    }
+}
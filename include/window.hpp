@@ -3,48 +3,55 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <span>
+#include <array>
 #include <utility>
 #include <algorithm>
 #include <cassert>
+#include <limits>
 
-bool check_collision(const std::vector<SDL_Rect> &A, const std::vector<SDL_Rect> &B) {
+bool check_collision(std::span<const SDL_Rect> A, std::span<const SDL_Rect> B) {
     // check collision function based on Lazy Foo' Productions (https://lazyfoo.net/SDL_tutorials/)
     int left_A, left_B;
     int right_A, right_B;
     int top_A, top_B;
     int bottom_A, bottom_B;
+    unsigned long tests = 0;
     
     // for each rect in A
-    for(std::vector<SDL_Rect>::size_type box_A = 0; box_A < A.size(); ++box_A) {
+    for(std::span<const SDL_Rect>::size_type box_A = 0; box_A < A.size(); ++box_A) {
         left_A = A[box_A].x;
         right_A = A[box_A].x + A[box_A].w;
         top_A = A[box_A].y;
         bottom_A = A[box_A].y + A[box_A].h;
         
         // for each rect in B
-        for(std::vector<SDL_Rect>::size_type box_B = 0; box_B < B.size(); ++box_B) {
+        for(std::span<const SDL_Rect>::size_type box_B = 0; box_B < B.size(); ++box_B) {
+            ++tests;
             left_B = B[box_B].x;
             right_B = B[box_B].x + B[box_B].w;
             top_B = B[box_B].y;
             bottom_B = B[box_B].y + B[box_B].h;
             
             // if collision detected
-            if (((bottom_A <= top_B) || (top_A >= bottom_B) || (right_A <= left_B) || (left_A >= right_B)) == false ) { return true; }
+            if (((bottom_A <= top_B) || (top_A >= bottom_B) || (right_A <= left_B) || (left_A >= right_B)) == false ) { stats.add(COLLISION_RECT_TESTS, tests); return true; }
         }
     }
 
+    stats.add(COLLISION_RECT_TESTS, tests);
     return false;
 }
 
-bool check_collision(const std::vector<SDL_Rect> &A, const std::vector<button> &B) {
+bool check_collision(std::span<const SDL_Rect> A, const std::vector<button> &B) {
     // modified check collision function based on Lazy Foo' Productions (https://lazyfoo.net/SDL_tutorials/)
     int left_A, left_B;
     int right_A, right_B;
     int top_A, top_B;
     int bottom_A, bottom_B;
+    unsigned long tests = 0;
     
     // for each hitbox in A
-    for(std::vector<SDL_Rect>::size_type box_A = 0; box_A < A.size(); ++box_A) {
+    for(std::span<const SDL_Rect>::size_type box_A = 0; box_A < A.size(); ++box_A) {
         left_A = A[box_A].x;
         right_A = A[box_A].x + A[box_A].w;
         top_A = A[box_A].y;
@@ -52,46 +59,65 @@ bool check_collision(const std::vector<SDL_Rect> &A, const std::vector<button> &
         
         // for each hitbox in B
         for(std::vector<SDL_Rect>::size_type box_B = 0; box_B < B.size(); ++box_B) {
+            ++tests;
             left_B = B[box_B].hitbox.x;
             right_B = B[box_B].hitbox.x + B[box_B].hitbox.w;
             top_B = B[box_B].hitbox.y;
             bottom_B = B[box_B].hitbox.y + B[box_B].hitbox.h;
             
             // if collision detected
-             if (((bottom_A <= top_B) || (top_A >= bottom_B) || (right_A <= left_B) || (left_A >= right_B)) == false ) { return true; }
+             if (((bottom_A <= top_B) || (top_A >= bottom_B) || (right_A <= left_B) || (left_A >= right_B)) == false ) { stats.add(COLLISION_BUTTON_TESTS, tests); return true; }
         }
     }
 
+    stats.add(COLLISION_BUTTON_TESTS, tests);
     return false;
 }
 
-wall check_collision(const std::vector<SDL_Rect> &A, std::vector<wall> &B) {
+const wall* check_collision(std::span<const SDL_Rect> A, std::span<const wall> B) {
     // modified check collision function based on Lazy Foo' Productions (https://lazyfoo.net/SDL_tutorials/)
     int left_A, left_B;
     int right_A, right_B;
     int top_A, top_B;
     int bottom_A, bottom_B;
+    unsigned long tests = 0;
     
     // for each hitbox in A
-    for(std::vector<SDL_Rect>::size_type box_A = 0; box_A < A.size(); ++box_A) {
+    for(std::span<const SDL_Rect>::size_type box_A = 0; box_A < A.size(); ++box_A) {
         left_A = A[box_A].x;
         right_A = A[box_A].x + A[box_A].w;
         top_A = A[box_A].y;
         bottom_A = A[box_A].y + A[box_A].h;
         
         // for each hitbox in B
-        for(std::vector<SDL_Rect>::size_type box_B = 0; box_B < B.size(); ++box_B) {
+        for(std::span<const wall>::size_type box_B = 0; box_B < B.size(); ++box_B) {
+            ++tests;
             left_B = B[box_B].hitbox.x;
             right_B = B[box_B].hitbox.x + B[box_B].hitbox.w;
             top_B = B[box_B].hitbox.y;
             bottom_B = B[box_B].hitbox.y + B[box_B].hitbox.h;
             
             // if collision detected
-             if (((bottom_A <= top_B) || (top_A >= bottom_B) || (right_A <= left_B) || (left_A >= right_B)) == false ) { return wall(B[box_B].hitbox, true); }
+             if (((bottom_A <= top_B) || (top_A >= bottom_B) || (right_A <= left_B) || (left_A >= right_B)) == false ) { stats.add(COLLISION_WALL_TESTS, tests); return &B[box_B]; }
         }
     }
 
-    return wall(false);
+    stats.add(COLLISION_WALL_TESTS, tests);
+    return NULL;
+}
+
+// CLOCK
+// timers read a virtual clock instead of SDL_GetTicks while frames are stepped at a fixed rate
+bool clock_fixed = false;
+Uint32 clock_fixed_ticks = 0;
+
+Uint32 clock_ticks() {
+    return clock_fixed ? clock_fixed_ticks : SDL_GetTicks();
+}
+
+void clock_step(unsigned long frame) {
+    // place virtual clock at the start of the given frame
+    clock_fixed_ticks = frame * 1000 / FPS_CAP;
 }
 
 // TIMER CLASS
@@ -104,7 +130,7 @@ timer::timer() {
 void timer::start() {
     started = true;
     paused = false;
-    start_ticks = SDL_GetTicks();
+    start_ticks = clock_ticks();
 }
 void timer::stop() {
     started = false;
@@ -113,13 +139,13 @@ void timer::stop() {
 void timer::pause() {
     if ((started == true) && (paused == false)) {
         paused = true;
-        paused_ticks = SDL_GetTicks() - start_ticks;
+        paused_ticks = clock_ticks() - start_ticks;
     }
 }
 void timer::unpause() {
     if (paused == true) {
         paused = false;
-        start_ticks = SDL_GetTicks() - paused_ticks;
+        start_ticks = clock_ticks() - paused_ticks;
         paused_ticks = 0;
     }
 }
@@ -128,7 +154,7 @@ int timer::get_ticks() const {
     if (started == true) {
         // if timer is paused
         if (paused == true) { return paused_ticks; }
-        else { return SDL_GetTicks() - start_ticks; }
+        else { return clock_ticks() - start_ticks; }
     }
     // if timer is not running
     return 0;
@@ -142,7 +168,6 @@ button::button(int x, int y, int w, int h, std::pair<int, int> p) {
     hitbox.y = y;
     hitbox.w = w;
     hitbox.h = h;
-    hitbox_vector.emplace_back(hitbox);
     pos.first = p.first;
     pos.second = p.second;
     colour = false;
@@ -151,76 +176,36 @@ button::button(int x, int y, int w, int h, std::pair<int, int> p) {
     filled = false;
     complete = false;
 }
-void button::handle(std::vector<std::vector<button>> &grid, std::vector<wall> &walls_list, std::vector<button> &walls_to_build_black, std::vector<button> &walls_to_build_white, orientation &wall_orientation) {
-    // start recurssion
-    if (walls_to_build_black.empty() && walls_to_build_white.empty()){
-        check_adjacent_wall(grid, walls_list, walls_to_build_black, walls_to_build_white, pos, true, true, 0, wall_orientation);
-    }
+void button::handle(std::vector<std::vector<button>> &grid, std::vector<wall> &walls_list, wall_occupancy &occupancy, std::vector<button> &walls_to_build_black, std::vector<button> &walls_to_build_white, orientation &wall_orientation, int now) {
+    trace_zone zone("place_wall");
+
+    // one wall at a time
+    if (!walls_to_build_black.empty() || !walls_to_build_white.empty()) { return; }
+
+    // nothing is placed on a built cell
+    occupancy.sync(walls_list);
+    const int col = pos.first;
+    const int row = pos.second;
+    if (occupancy.is_built(col, row)) { return; }
+
+    // the wall reaches up to the nearest built cell or the edge of the grid each way
+    const bool vertical = (wall_orientation == orientation::vertical);
+    const int at = vertical ? row : col;
+    const int next_end = (vertical ? occupancy.next_in_col(col, row) : occupancy.next_in_row(col, row)) - 1;
+    const int prev_end = (vertical ? occupancy.previous_in_col(col, row) : occupancy.previous_in_row(col, row)) + 1;
+    auto cell = [&](int n) -> button& { return vertical ? grid[col][n] : grid[n][row]; };
+
+    // queue the black half from its far end, then the cell placed, then the white half from its far end
+    for (int n = next_end; n > at; --n) { cell(n).queue_wall(walls_to_build_black, true, n - at, now); }
+    queue_wall(walls_to_build_black, true, 0, now);
+    for (int n = prev_end; n < at; ++n) { cell(n).queue_wall(walls_to_build_white, false, at - n, now); }
 }
-void button::check_adjacent_wall(std::vector<std::vector<button>> &grid, std::vector<wall> &walls_list, std::vector<button> &walls_to_build_black, std::vector<button> &walls_to_build_white, std::pair<int, int> pos, bool orig_flag, bool next_flag, int counter, orientation wall_orientation) {
-
-    int col = pos.first;
-    int row = pos.second;
-
-    int next_col, prev_col, next_row, prev_row;
-
-    int max_col = (SCREEN_WIDTH - 2*GRID_X_OFFSET) / GRID_DIM - 1;
-    int max_row = (SCREEN_HEIGHT - 2*GRID_Y_OFFSET) / GRID_DIM - 1;
-
-    // if walls have reached end of grid
-    if ((col > max_col) || (col < 0) || (row > max_row) || (row < 0)) { return; }
-
-    // if its not the original wall, increment counter
-    if (!orig_flag) { ++counter; }
-
-    // check collision with any walls
-    if (check_collision(hitbox_vector, walls_list)) { return; }
-  
-    // else
+void button::queue_wall(std::vector<button> &walls_to_build, bool next_flag, int counter, int now) {
     active = true;
     colour = next_flag;
-    delay_timer.start();
+    queued_at = now;
     delay_counter = counter;
-
-    if (wall_orientation == orientation::vertical){
-        next_col = col;
-        prev_col = col;
-        next_row = row + 1;
-        prev_row = row - 1;
-    } else {
-        next_col = col + 1;
-        prev_col = col - 1;
-        next_row = row;
-        prev_row = row;    
-    }
-    
-    if (orig_flag){
-        // ensure bounds, check both
-        if (next_col <= max_col && next_row <= max_row) {
-            // check next
-            grid[next_col][next_row].check_adjacent_wall(grid, walls_list, walls_to_build_black, walls_to_build_white, std::make_pair(next_col, next_row), false, true, counter, wall_orientation);
-        }
-        if (prev_col >= 0 && prev_row >= 0) {
-            // check previous
-            grid[prev_col][prev_row].check_adjacent_wall(grid, walls_list, walls_to_build_black, walls_to_build_white, std::make_pair(prev_col, prev_row), false, false, counter, wall_orientation);
-        }
-    } else if (next_flag) {
-        // ensure bounds
-        if (next_col <= max_col && next_row <= max_row) {
-            // continue next
-            grid[next_col][next_row].check_adjacent_wall(grid, walls_list, walls_to_build_black, walls_to_build_white, std::make_pair(next_col, next_row), false, true, counter, wall_orientation);
-        }
-    } else {
-        // ensure bounds
-        if (prev_col >= 0 && prev_row >= 0) {
-            // continue previous
-            grid[prev_col][prev_row].check_adjacent_wall(grid, walls_list, walls_to_build_black, walls_to_build_white, std::make_pair(prev_col, prev_row), false, false, counter, wall_orientation);
-        }
-    }
-    
-    // finally
-    if (colour) { walls_to_build_black.emplace_back(*this); }
-    else { walls_to_build_white.emplace_back(*this); }
+    walls_to_build.emplace_back(*this);
 }
 int button::col() const { return pos.first; }
 int button::row() const { return pos.second; }
@@ -232,6 +217,191 @@ void button::reset () {
     complete = false;
 }
 
+// WALL OCCUPANCY CLASS
+wall_occupancy::wall_occupancy() {
+    cols = (SCREEN_WIDTH - 2*GRID_X_OFFSET) / GRID_DIM;
+    rows = (SCREEN_HEIGHT - 2*GRID_Y_OFFSET) / GRID_DIM;
+    row_words = (cols + 63) / 64;
+    col_words = (rows + 63) / 64;
+    row_bits.assign(std::size_t(rows) * row_words, 0);
+    col_bits.assign(std::size_t(cols) * col_words, 0);
+    synced = 0;
+}
+void wall_occupancy::clear() {
+    std::fill(row_bits.begin(), row_bits.end(), 0);
+    std::fill(col_bits.begin(), col_bits.end(), 0);
+    synced = 0;
+}
+void wall_occupancy::set(int col, int row) {
+    row_bits[std::size_t(row)*row_words + col / 64] |= std::uint64_t(1) << (col % 64);
+    col_bits[std::size_t(col)*col_words + row / 64] |= std::uint64_t(1) << (row % 64);
+}
+void wall_occupancy::sync(const std::vector<wall> &walls_list) {
+    if (walls_list.size() < synced) { clear(); }
+    for (; synced < walls_list.size(); ++synced) {
+        const SDL_Rect &hitbox = walls_list[synced].hitbox;
+        set((hitbox.x - GRID_X_OFFSET) / GRID_DIM, (hitbox.y - GRID_Y_OFFSET) / GRID_DIM);
+    }
+}
+bool wall_occupancy::is_built(int col, int row) const {
+    return (row_bits[std::size_t(row)*row_words + col / 64] >> (col % 64)) & 1;
+}
+int next_set_bit(const std::uint64_t* words, int bits, int from) {
+    // first set bit at or after from, bits if none
+    if (from >= bits) { return bits; }
+    int word = from / 64;
+    std::uint64_t current = words[word] & (~std::uint64_t(0) << (from % 64));
+    const int words_count = (bits + 63) / 64;
+    while (current == 0) {
+        if (++word == words_count) { return bits; }
+        current = words[word];
+    }
+    return std::min(word*64 + std::countr_zero(current), bits);
+}
+int previous_set_bit(const std::uint64_t* words, int from) {
+    // last set bit at or before from, -1 if none
+    if (from < 0) { return -1; }
+    int word = from / 64;
+    std::uint64_t current = words[word] & (~std::uint64_t(0) >> (63 - from % 64));
+    while (current == 0) {
+        if (--word < 0) { return -1; }
+        current = words[word];
+    }
+    return word*64 + 63 - std::countl_zero(current);
+}
+int wall_occupancy::next_in_col(int col, int row) const { return next_set_bit(&col_bits[std::size_t(col)*col_words], rows, row); }
+int wall_occupancy::previous_in_col(int col, int row) const { return previous_set_bit(&col_bits[std::size_t(col)*col_words], row); }
+int wall_occupancy::next_in_row(int col, int row) const { return next_set_bit(&row_bits[std::size_t(row)*row_words], cols, col); }
+int wall_occupancy::previous_in_row(int col, int row) const { return previous_set_bit(&row_bits[std::size_t(row)*row_words], col); }
+
+// REGION MAP CLASS
+region_map::region_map() {
+    cols = (SCREEN_WIDTH - 2*GRID_X_OFFSET) / GRID_DIM;
+    rows = (SCREEN_HEIGHT - 2*GRID_Y_OFFSET) / GRID_DIM;
+    const std::size_t cells = std::size_t(cols) * rows;
+    label.assign(cells, -1);
+    stack.reserve(cells + 1);
+    count = 0;
+    synced = 0;
+
+    // a wall borders at most four regions, one per side
+    walls.reserve(4 * cells);
+    wall_start.reserve(cells + 1);
+    ball_start.reserve(cells + 1);
+
+    // no walls, one region of every cell
+    relabel(std::vector<wall>());
+}
+void region_map::relabel(const std::vector<wall> &walls_list) {
+    // built cells first, open cells wait to be labelled
+    std::fill(label.begin(), label.end(), -2);
+    for (const wall &w : walls_list) {
+        label[((w.hitbox.x - GRID_X_OFFSET) / GRID_DIM) * rows + (w.hitbox.y - GRID_Y_OFFSET) / GRID_DIM] = -1;
+    }
+
+    // flood each region of open cells
+    count = 0;
+    for (int first = 0; first < cols * rows; ++first) {
+        if (label[first] != -2) { continue; }
+        stack.clear();
+        stack.emplace_back(first);
+        label[first] = count;
+        while (!stack.empty()) {
+            const int cell = stack.back();
+            stack.pop_back();
+            const int col = cell / rows;
+            const int row = cell % rows;
+            if (col > 0 && label[cell - rows] == -2) { label[cell - rows] = count; stack.emplace_back(cell - rows); }
+            if (col < cols - 1 && label[cell + rows] == -2) { label[cell + rows] = count; stack.emplace_back(cell + rows); }
+            if (row > 0 && label[cell - 1] == -2) { label[cell - 1] = count; stack.emplace_back(cell - 1); }
+            if (row < rows - 1 && label[cell + 1] == -2) { label[cell + 1] = count; stack.emplace_back(cell + 1); }
+        }
+        ++count;
+    }
+
+    // regions around a wall, from the eight cells next to it
+    const auto regions_around = [this](const wall &w, std::array<int, 8> &around) {
+        const int col = (w.hitbox.x - GRID_X_OFFSET) / GRID_DIM;
+        const int row = (w.hitbox.y - GRID_Y_OFFSET) / GRID_DIM;
+        int found = 0;
+        for (int c = std::max(col - 1, 0); c <= std::min(col + 1, cols - 1); ++c) {
+            for (int r = std::max(row - 1, 0); r <= std::min(row + 1, rows - 1); ++r) {
+                const int region = label[c * rows + r];
+                if (region >= 0 && std::find(around.begin(), around.begin() + found, region) == around.begin() + found) { around[found++] = region; }
+            }
+        }
+        return found;
+    };
+
+    // count the walls of each region, then place them in walls_list order
+    std::array<int, 8> around;
+    wall_start.assign(count + 1, 0);
+    for (const wall &w : walls_list) {
+        const int found = regions_around(w, around);
+        for (int n = 0; n < found; ++n) { ++wall_start[around[n] + 1]; }
+    }
+    for (int region = 0; region < count; ++region) { wall_start[region + 1] += wall_start[region]; }
+    walls.assign(wall_start[count], wall(false));
+    stack.assign(wall_start.begin(), wall_start.end() - 1);
+    for (const wall &w : walls_list) {
+        const int found = regions_around(w, around);
+        for (int n = 0; n < found; ++n) { walls[stack[around[n]]++] = w; }
+    }
+    synced = walls_list.size();
+}
+int region_map::region_of(const ball &b) const {
+    // the centre decides the region, every open cell under the ball's box has to be in it too
+    const auto col_of = [this](float x) { return std::clamp(int(std::floor((x - GRID_X_OFFSET) / GRID_DIM)), 0, cols - 1); };
+    const auto row_of = [this](float y) { return std::clamp(int(std::floor((y - GRID_Y_OFFSET) / GRID_DIM)), 0, rows - 1); };
+    const int region = label[col_of(b.x_pos + b.rad / 2.0f) * rows + row_of(b.y_pos + b.rad / 2.0f)];
+    if (region < 0) { return -1; }
+
+    // box a pixel wider than the ball on the far sides, so a ball resting against a cell counts as reaching it
+    const float left = std::floor(b.x_pos);
+    const float top = std::floor(b.y_pos);
+    for (int col = col_of(left); col <= col_of(left + b.rad); ++col) {
+        for (int row = row_of(top); row <= row_of(top + b.rad); ++row) {
+            const int other = label[col * rows + row];
+            if (other >= 0 && other != region) { return -1; }
+        }
+    }
+    return region;
+}
+bool region_map::sync(const std::vector<wall> &walls_list, const std::vector<ball> &balls_list) {
+    // walls are only appended until a level is reset, which empties the list
+    if (walls_list.size() != synced) { relabel(walls_list); }
+
+    // room for as many balls as the list has, so later levels do not allocate
+    const std::size_t balls = balls_list.size();
+    if (every_ball.capacity() < balls_list.capacity()) {
+        every_ball.reserve(balls_list.capacity());
+        ball_index.reserve(balls_list.capacity());
+        ball_region.reserve(balls_list.capacity());
+    }
+    if (every_ball.size() != balls) {
+        every_ball.resize(balls);
+        std::iota(every_ball.begin(), every_ball.end(), 0);
+    }
+
+    // count the balls of each region, then place them in balls_list order
+    ball_region.resize(balls);
+    ball_start.assign(count + 1, 0);
+    for (std::size_t n = 0; n < balls; ++n) {
+        ball_region[n] = region_of(balls_list[n]);
+        if (ball_region[n] < 0) { return false; }
+        ++ball_start[ball_region[n] + 1];
+    }
+    for (int region = 0; region < count; ++region) { ball_start[region + 1] += ball_start[region]; }
+    ball_index.resize(balls);
+    stack.assign(ball_start.begin(), ball_start.end() - 1);
+    for (std::size_t n = 0; n < balls; ++n) { ball_index[stack[ball_region[n]]++] = n; }
+    return true;
+}
+int region_map::regions() const { return count; }
+std::span<const wall> region_map::walls_of(int region) const { return std::span<const wall>(walls).subspan(wall_start[region], wall_start[region + 1] - wall_start[region]); }
+std::span<const std::size_t> region_map::balls_of(int region) const { return std::span<const std::size_t>(ball_index).subspan(ball_start[region], ball_start[region + 1] - ball_start[region]); }
+std::span<const std::size_t> region_map::all_balls() const { return every_ball; }
+
 // WALL CLASS
 wall::wall(SDL_Rect wall, bool collision, bool colour) {
     hitbox = wall;
@@ -247,14 +417,126 @@ wall::wall(bool collision) {
 }
 wall::operator bool() const { return collision; }
 
+// SWEPT COLLISION
+const int MAX_SWEEPS = 8;
+
+struct impact {
+    // fraction of the step at which the impact happens, 1 if nothing is hit
+    float time = 1;
+
+    // axes to reflect and position on impact along those axes
+    bool x_axis = false;
+    bool y_axis = false;
+    float x_pos = 0;
+    float y_pos = 0;
+
+    // wall that was hit, if any
+    bool wall = false;
+    SDL_Rect hitbox{};
+
+    // keep the earlier impact, combine axes of simultaneous impacts
+    bool merge(float t, bool x, bool y, float x_contact, float y_contact) {
+        const float epsilon = 1e-6;
+        if (t < time - epsilon) {
+            time = t;
+            x_axis = false;
+            y_axis = false;
+            wall = false;
+        } else if (t > time + epsilon) {
+            return false;
+        }
+        if (x) { x_axis = true; x_pos = x_contact; }
+        if (y) { y_axis = true; y_pos = y_contact; }
+        return true;
+    }
+};
+
+bool sweep_axis(float pos, int size, float displacement, int other_pos, int other_size, float &entry, float &exit) {
+    // fraction of the step at which a moving span enters and leaves a static span
+    if (displacement > 0) {
+        entry = (other_pos - (pos + size)) / displacement;
+        exit = (other_pos + other_size - pos) / displacement;
+    } else if (displacement < 0) {
+        entry = (other_pos + other_size - pos) / displacement;
+        exit = (other_pos - (pos + size)) / displacement;
+    } else {
+        // not moving, overlapping for the whole step or never
+        if ((pos >= other_pos + other_size) || (pos + size <= other_pos)) { return false; }
+        entry = -std::numeric_limits<float>::infinity();
+        exit = std::numeric_limits<float>::infinity();
+    }
+    return true;
+}
+
+struct fixed_impact {
+    // fraction of the step at which the impact happens in fixed point, one if nothing is hit
+    fixed_wide time = FIXED_ONE;
+
+    // axes to reflect and position on impact along those axes
+    bool x_axis = false;
+    bool y_axis = false;
+    fixed x_pos = 0;
+    fixed y_pos = 0;
+
+    // wall that was hit, if any
+    bool wall = false;
+    SDL_Rect hitbox{};
+
+    // keep the earlier impact, combine axes of impacts at exactly the same time
+    bool merge(fixed_wide t, bool x, bool y, fixed x_contact, fixed y_contact) {
+        if (t < time) {
+            time = t;
+            x_axis = false;
+            y_axis = false;
+            wall = false;
+        } else if (t > time) {
+            return false;
+        }
+        if (x) { x_axis = true; x_pos = x_contact; }
+        if (y) { y_axis = true; y_pos = y_contact; }
+        return true;
+    }
+};
+
+bool sweep_axis_fixed(fixed_wide pos, int size, fixed_wide displacement, int other_pos, int other_size, fixed_wide &entry, fixed_wide &exit) {
+    // fixed point sweep_axis
+    if (displacement > 0) {
+        entry = fixed_div(to_fixed(other_pos) - (pos + to_fixed(size)), displacement);
+        exit = fixed_div(to_fixed(other_pos + other_size) - pos, displacement);
+    } else if (displacement < 0) {
+        entry = fixed_div(to_fixed(other_pos + other_size) - pos, displacement);
+        exit = fixed_div(to_fixed(other_pos) - (pos + to_fixed(size)), displacement);
+    } else {
+        if ((pos >= to_fixed(other_pos + other_size)) || (pos + to_fixed(size) <= to_fixed(other_pos))) { return false; }
+        entry = std::numeric_limits<fixed_wide>::min();
+        exit = std::numeric_limits<fixed_wide>::max();
+    }
+    return true;
+}
+
+bool check_contact(ball &current_ball, const std::vector<button> &B) {
+    // check if the ball touched any of the given walls since the last check
+    for (int n = 0; n < current_ball.contact_count; ++n) {
+        const SDL_Rect &contact = current_ball.contacts[n];
+        for (const button &current_wall : B) {
+            if ((contact.x == current_wall.hitbox.x) && (contact.y == current_wall.hitbox.y)) { return true; }
+        }
+    }
+    return false;
+}
+
 // BALL CLASS
 ball::ball(int x, int y, int speed) {
     x_pos = x;
     y_pos = y;
     x_speed = speed;
     y_speed = speed;
+    x_fixed = to_fixed(x);
+    y_fixed = to_fixed(y);
+    x_speed_fixed = to_fixed(speed);
+    y_speed_fixed = to_fixed(speed);
+    contact_count = 0;
 
-    hitbox.resize(11);
     hitbox[ 0 ].w = 6;  hitbox[ 0 ].h = 1;
     hitbox[ 1 ].w = 10; hitbox[ 1 ].h = 1;
     hitbox[ 2 ].w = 14; hitbox[ 2 ].h = 1;
@@ -268,33 +550,240 @@ ball::ball(int x, int y, int speed) {
     hitbox[ 10 ].w = 6; hitbox[ 10 ].h = 1;
     shift_boxes();
 }
-void ball::update(timer &ball_timer) {
-
-    // set x-direction
-    x_pos += x_speed * (ball_timer.get_ticks()/1000.f);
-    if ((x_pos <= GRID_X_OFFSET) || (x_pos + rad >= SCREEN_WIDTH - GRID_X_OFFSET)) {
-        x_speed *= -1;
-        x_pos = std::clamp(x_pos, float(GRID_X_OFFSET), float(SCREEN_WIDTH - GRID_X_OFFSET - rad));
+void ball::update(int dt_ms, std::span<const wall> walls) {
+    if (physics_fixed) {
+        update_fixed(dt_ms, walls);
+        return;
     }
 
-    // set y-direction
-    y_pos += y_speed * (ball_timer.get_ticks()/1000.f);
-    if ((y_pos <= GRID_Y_OFFSET) || (y_pos + rad >= SCREEN_HEIGHT - GRID_Y_OFFSET)) {
-        y_speed *= -1;
-        y_pos = std::clamp(y_pos, float(GRID_Y_OFFSET), float(SCREEN_HEIGHT - GRID_Y_OFFSET - rad));
+    const float dt = dt_ms/1000.f;
+    const float min_x = GRID_X_OFFSET;
+    const float max_x = SCREEN_WIDTH - GRID_X_OFFSET - rad;
+    const float min_y = GRID_Y_OFFSET;
+    const float max_y = SCREEN_HEIGHT - GRID_Y_OFFSET - rad;
+
+    stats.add(BALLS_UPDATED, 1);
+
+    // keep ball within playfield
+    x_pos = std::clamp(x_pos, min_x, max_x);
+    y_pos = std::clamp(y_pos, min_y, max_y);
+
+    // move to the earliest impact in the step, reflect, and continue with the time left over
+    float remaining = dt;
+    for (int sweep = 0; sweep < MAX_SWEEPS && remaining > 0; ++sweep) {
+        const float dx = x_speed * remaining;
+        const float dy = y_speed * remaining;
+        impact first;
+
+        // playfield boundaries
+        if (dx < 0) { first.merge(std::max((min_x - x_pos) / dx, 0.f), true, false, min_x, 0); }
+        if (dx > 0) { first.merge(std::max((max_x - x_pos) / dx, 0.f), true, false, max_x, 0); }
+        if (dy < 0) { first.merge(std::max((min_y - y_pos) / dy, 0.f), false, true, 0, min_y); }
+        if (dy > 0) { first.merge(std::max((max_y - y_pos) / dy, 0.f), false, true, 0, max_y); }
+
+        // walls within the swept bounds of the ball
+        const float sweep_left = std::min(x_pos, x_pos + dx);
+        const float sweep_right = std::max(x_pos, x_pos + dx) + rad;
+        const float sweep_top = std::min(y_pos, y_pos + dy);
+        const float sweep_bottom = std::max(y_pos, y_pos + dy) + rad;
+        for (const wall &current_wall : walls) {
+            const SDL_Rect &w = current_wall.hitbox;
+            if ((sweep_bottom <= w.y) || (sweep_top >= w.y + w.h) || (sweep_right <= w.x) || (sweep_left >= w.x + w.w)) { continue; }
+
+            // sweep each box of the hitbox against the wall
+            int row_offset = 0;
+            for (const SDL_Rect &box : hitbox) {
+                const int col_offset = (rad - box.w) / 2;
+                float x_entry, x_exit, y_entry, y_exit;
+                if (sweep_axis(x_pos + col_offset, box.w, dx, w.x, w.w, x_entry, x_exit) && sweep_axis(y_pos + row_offset, box.h, dy, w.y, w.h, y_entry, y_exit)) {
+                    const float entry = std::max(x_entry, y_entry);
+                    const float exit = std::min(x_exit, y_exit);
+                    // ignore boxes already overlapping, handle_wall_collisions pushes those out
+                    if (entry >= 0 && entry < exit && entry <= first.time) {
+                        // position at which the box touches the wall face
+                        const float x_contact = (dx > 0) ? w.x - box.w - col_offset : w.x + w.w - col_offset;
+                        const float y_contact = (dy > 0) ? w.y - box.h - row_offset : w.y + w.h - row_offset;
+                        if (first.merge(entry, x_entry >= y_entry, y_entry >= x_entry, x_contact, y_contact)) {
+                            first.wall = true;
+                            first.hitbox = w;
+                        }
+                    }
+                }
+                row_offset += box.h;
+            }
+        }
+
+        // nothing hit, move full step
+        if (first.time >= 1) {
+            x_pos += dx;
+            y_pos += dy;
+            break;
+        }
+
+        // move to impact and reflect
+        x_pos = first.x_axis ? first.x_pos : x_pos + dx * first.time;
+        y_pos = first.y_axis ? first.y_pos : y_pos + dy * first.time;
+        if (first.x_axis) { x_speed *= -1; }
+        if (first.y_axis) { y_speed *= -1; }
+        if (first.wall && contact_count < MAX_CONTACTS) { contacts[contact_count++] = first.hitbox; }
+        remaining *= 1 - first.time;
     }
 
     // shift hitbox
     shift_boxes();
 
 }
+void ball::update_fixed(int dt_ms, std::span<const wall> walls) {
+    const fixed min_x = to_fixed(GRID_X_OFFSET);
+    const fixed max_x = to_fixed(SCREEN_WIDTH - GRID_X_OFFSET - rad);
+    const fixed min_y = to_fixed(GRID_Y_OFFSET);
+    const fixed max_y = to_fixed(SCREEN_HEIGHT - GRID_Y_OFFSET - rad);
+
+    stats.add(BALLS_UPDATED, 1);
+
+    // keep ball within playfield
+    x_fixed = std::clamp(x_fixed, min_x, max_x);
+    y_fixed = std::clamp(y_fixed, min_y, max_y);
+
+    // same sweep as the float update, with the time left over kept as a fraction of the step
+    fixed_wide remaining = FIXED_ONE;
+    for (int sweep = 0; sweep < MAX_SWEEPS && remaining > 0; ++sweep) {
+        // speeds are in pixels per second
+        const fixed_wide dx = fixed_mul(fixed_wide(x_speed_fixed) * dt_ms / 1000, remaining);
+        const fixed_wide dy = fixed_mul(fixed_wide(y_speed_fixed) * dt_ms / 1000, remaining);
+        fixed_impact first;
+
+        // playfield boundaries
+        if (dx < 0) { first.merge(std::max<fixed_wide>(fixed_div(min_x - x_fixed, dx), 0), true, false, min_x, 0); }
+        if (dx > 0) { first.merge(std::max<fixed_wide>(fixed_div(max_x - x_fixed, dx), 0), true, false, max_x, 0); }
+        if (dy < 0) { first.merge(std::max<fixed_wide>(fixed_div(min_y - y_fixed, dy), 0), false, true, 0, min_y); }
+        if (dy > 0) { first.merge(std::max<fixed_wide>(fixed_div(max_y - y_fixed, dy), 0), false, true, 0, max_y); }
+
+        // walls within the swept bounds of the ball
+        const fixed_wide sweep_left = std::min<fixed_wide>(x_fixed, x_fixed + dx);
+        const fixed_wide sweep_right = std::max<fixed_wide>(x_fixed, x_fixed + dx) + to_fixed(rad);
+        const fixed_wide sweep_top = std::min<fixed_wide>(y_fixed, y_fixed + dy);
+        const fixed_wide sweep_bottom = std::max<fixed_wide>(y_fixed, y_fixed + dy) + to_fixed(rad);
+        for (const wall &current_wall : walls) {
+            const SDL_Rect &w = current_wall.hitbox;
+            if ((sweep_bottom <= to_fixed(w.y)) || (sweep_top >= to_fixed(w.y + w.h)) || (sweep_right <= to_fixed(w.x)) || (sweep_left >= to_fixed(w.x + w.w))) { continue; }
+
+            // sweep each box of the hitbox against the wall
+            int row_offset = 0;
+            for (const SDL_Rect &box : hitbox) {
+                const int col_offset = (rad - box.w) / 2;
+                fixed_wide x_entry, x_exit, y_entry, y_exit;
+                if (sweep_axis_fixed(x_fixed + to_fixed(col_offset), box.w, dx, w.x, w.w, x_entry, x_exit) && sweep_axis_fixed(y_fixed + to_fixed(row_offset), box.h, dy, w.y, w.h, y_entry, y_exit)) {
+                    const fixed_wide entry = std::max(x_entry, y_entry);
+                    const fixed_wide exit = std::min(x_exit, y_exit);
+                    // ignore boxes already overlapping, handle_wall_collisions pushes those out
+                    if (entry >= 0 && entry < exit && entry <= first.time) {
+                        // position at which the box touches the wall face
+                        const fixed x_contact = to_fixed((dx > 0) ? w.x - box.w - col_offset : w.x + w.w - col_offset);
+                        const fixed y_contact = to_fixed((dy > 0) ? w.y - box.h - row_offset : w.y + w.h - row_offset);
+                        if (first.merge(entry, x_entry >= y_entry, y_entry >= x_entry, x_contact, y_contact)) {
+                            first.wall = true;
+                            first.hitbox = w;
+                        }
+                    }
+                }
+                row_offset += box.h;
+            }
+        }
+
+        // nothing hit, move full step
+        if (first.time >= FIXED_ONE) {
+            x_fixed += dx;
+            y_fixed += dy;
+            break;
+        }
+
+        // move to impact and reflect
+        x_fixed = first.x_axis ? first.x_pos : x_fixed + fixed_mul(dx, first.time);
+        y_fixed = first.y_axis ? first.y_pos : y_fixed + fixed_mul(dy, first.time);
+        if (first.x_axis) { x_speed_fixed = -x_speed_fixed; }
+        if (first.y_axis) { y_speed_fixed = -y_speed_fixed; }
+        if (first.wall && contact_count < MAX_CONTACTS) { contacts[contact_count++] = first.hitbox; }
+        remaining = fixed_mul(remaining, FIXED_ONE - first.time);
+    }
+
+    // shift hitbox
+    sync_fixed();
+    shift_boxes();
+}
+void ball::bounce_fixed(ball &other_ball) {
+    // fixed point version of the response in handle_ball_collisions
+    // if x-directions are different
+    if ((x_speed_fixed > 0 && other_ball.x_speed_fixed < 0) || (x_speed_fixed < 0 && other_ball.x_speed_fixed > 0)) {
+        x_speed_fixed = -x_speed_fixed;
+        other_ball.x_speed_fixed = -other_ball.x_speed_fixed;
+        set_direction_fixed(x_fixed, other_ball.x_fixed);
+    }
+    // if y-directions are different
+    else if ((y_speed_fixed > 0 && other_ball.y_speed_fixed < 0) || (y_speed_fixed < 0 && other_ball.y_speed_fixed > 0)) {
+        y_speed_fixed = -y_speed_fixed;
+        other_ball.y_speed_fixed = -other_ball.y_speed_fixed;
+        set_direction_fixed(y_fixed, other_ball.y_fixed);
+    }
+    // else
+    else {
+        x_speed_fixed = -x_speed_fixed;
+        y_speed_fixed = -y_speed_fixed;
+        other_ball.x_speed_fixed = -other_ball.x_speed_fixed;
+        other_ball.y_speed_fixed = -other_ball.y_speed_fixed;
+        set_direction_fixed(x_fixed, other_ball.x_fixed);
+        set_direction_fixed(y_fixed, other_ball.y_fixed);
+    }
+    sync_fixed();
+    other_ball.sync_fixed();
+}
+void ball::push_out_fixed(const SDL_Rect &w) {
+    // fixed point version of the response in handle_wall_collisions
+    const fixed dx = (x_fixed + to_fixed(rad))/2 - to_fixed((w.x + w.w)/2);
+    const fixed dy = (y_fixed + to_fixed(rad))/2 - to_fixed((w.y + w.h)/2);
+    const fixed offset = to_fixed(rad) / 10;
+
+    // if dx and dy are very close, assume equal collision
+    if (fixed_wide(dx)*dx + fixed_wide(dy)*dy < fixed_wide(FIXED_ONE)*FIXED_ONE) {
+        x_speed_fixed = -x_speed_fixed;
+        y_speed_fixed = -y_speed_fixed;
+    }
+    // x-collision
+    else if (std::abs(dx) > std::abs(dy)) {
+        x_speed_fixed = -x_speed_fixed;
+        // wall <- ball
+        if (dx >= 0) { x_fixed = std::clamp(x_fixed, to_fixed(w.x + w.w), to_fixed(SCREEN_WIDTH - GRID_X_OFFSET - rad)) + offset; }
+        // ball -> wall
+        else { x_fixed = std::clamp(x_fixed, to_fixed(GRID_X_OFFSET), to_fixed(w.x)) - offset; }
+    }
+    // y-collision
+    else {
+        y_speed_fixed = -y_speed_fixed;
+        // ball ^ wall
+        if (dy >= 0) { y_fixed = std::clamp(y_fixed, to_fixed(w.y + w.h), to_fixed(SCREEN_HEIGHT - GRID_Y_OFFSET - rad)) + offset; }
+        // ball v wall
+        else { y_fixed = std::clamp(y_fixed, to_fixed(GRID_Y_OFFSET), to_fixed(w.y)) - offset; }
+    }
+    sync_fixed();
+    shift_boxes();
+}
+void ball::sync_fixed() {
+    x_pos = fixed_to_float(x_fixed);
+    y_pos = fixed_to_float(y_fixed);
+    x_speed = fixed_to_float(x_speed_fixed);
+    y_speed = fixed_to_float(y_speed_fixed);
+}
 void ball::shift_boxes() {
+    // whole pixel position, floored from fixed point rather than truncated from float
+    const int x = physics_fixed ? fixed_floor(x_fixed) : x_pos;
+    const int y = physics_fixed ? fixed_floor(y_fixed) : y_pos;
+
     int row_offset = 0;
-    for (std::vector<SDL_Rect>::size_type set = 0; set < hitbox.size(); set++) {
+    for (std::size_t set = 0; set < hitbox.size(); set++) {
         // center box
-        hitbox[set].x = x_pos + (rad - hitbox[set].w) / 2;
+        hitbox[set].x = x + (rad - hitbox[set].w) / 2;
         // set box at row offset
-        hitbox[set].y = y_pos + row_offset;
+        hitbox[set].y = y + row_offset;
         // move row offset down to height of box
         row_offset += hitbox[set].h;
     }
@@ -308,19 +797,53 @@ void ball::set_direction(float &pos, float &other_pos) {
         other_pos -= 1;
     }
 }
+void ball::set_direction_fixed(fixed &pos, fixed &other_pos) {
+    if (pos < other_pos) {
+        pos -= FIXED_ONE;
+        other_pos += FIXED_ONE;
+    } else {
+        pos += FIXED_ONE;
+        other_pos -= FIXED_ONE;
+    }
+}
 void ball::set_position(float x, float y) {
     x_pos = x;
     y_pos = y;
+    x_fixed = float_to_fixed(x);
+    y_fixed = float_to_fixed(y);
     shift_boxes();
 }
+void ball::set_speed(float x, float y) {
+    x_speed = x;
+    y_speed = y;
+    x_speed_fixed = float_to_fixed(x);
+    y_speed_fixed = float_to_fixed(y);
+}
+
+void window_init(const options &parameters) {
+    // composite into a memory surface instead of opening a window
+    if (parameters.HEADLESS) { SDL_putenv(const_cast<char*>("SDL_VIDEODRIVER=dummy")); }
 
-void window_init() {
     // initialize all SDL subsystems
     int sdl_init = SDL_Init(SDL_INIT_EVERYTHING);
     assert(sdl_init == 0);
 
-    // set up screen (using SDL_HWSURFACE since background generally remains static)
-    screen = SDL_SetVideoMode(SCREEN_WIDTH, SCREEN_HEIGHT, SCREEN_BPP, SDL_HWSURFACE | SDL_DOUBLEBUF);
+    // set up window at the requested resolution (using SDL_HWSURFACE since background generally remains static)
+    window_surface = SDL_SetVideoMode(parameters.RESOLUTION.first, parameters.RESOLUTION.second, SCREEN_BPP, SDL_HWSURFACE | SDL_DOUBLEBUF);
+    assert(window_surface != NULL);
+
+    // frames are composited at 800x600 and scaled into the window when it is a different size
+    screen_scaler.init(SCREEN_WIDTH, SCREEN_HEIGHT, window_surface->w, window_surface->h, parameters.SCALE_FILTER);
+    screen_scaler.scale_every_tile(page_flipped(window_surface));
+    if (parameters.INDEXED_RENDER) {
+        // 8 bit frames are always expanded into the window, their palette is set once the artwork is loaded
+        screen = SDL_CreateRGBSurface(SDL_SWSURFACE, SCREEN_WIDTH, SCREEN_HEIGHT, 8, 0, 0, 0, 0);
+    } else if (screen_scaler.is_enabled()) {
+        const SDL_PixelFormat* format = window_surface->format;
+        screen = SDL_CreateRGBSurface(SDL_SWSURFACE, SCREEN_WIDTH, SCREEN_HEIGHT, SCREEN_BPP, format->Rmask, format->Gmask, format->Bmask, format->Amask);
+    } else {
+        screen = window_surface;
+    }
     assert(screen != NULL);
 
     // set up cursor
@@ -361,6 +884,21 @@ SDL_Surface* load_image (const std::string filename) {
     return img_optimized;
 }
 
+void index_images() {
+    // convert the artwork to a palette of its colours, shared with the frame
+    std::array<SDL_Surface**, 11> images = {&background_surface, &pause_surface, &level_complete_surface, &game_over_surface, &game_over_animation_surface, &game_winner_surface, &game_winner_animation_surface, &balls_surface, &wall_black, &wall_white, &digits_surface};
+    for (SDL_Surface** image : images) { screen_palette.add(*image); }
+    screen_palette.build();
+    for (SDL_Surface** image : images) {
+        SDL_Surface* indexed = screen_palette.convert(*image);
+        assert(indexed != NULL);
+        SDL_FreeSurface(*image);
+        *image = indexed;
+    }
+    screen_palette.apply(screen);
+    screen_scaler.set_palette(screen->format->palette, window_surface->format);
+}
+
 void load_files(const options &parameters) {
     // load images
     background_surface = load_image("assets/background.bmp");
@@ -390,6 +928,8 @@ void load_files(const options &parameters) {
 
     // ensure ball surface has same height and width
     assert(balls_surface->w == balls_surface->h);
+
+    if (parameters.INDEXED_RENDER) { index_images(); }
 }
 
 void apply_surface(int x, int y, SDL_Surface* source, SDL_Surface* destination, SDL_Rect* clip = NULL) {
@@ -406,10 +946,14 @@ void apply_surface(int x, int y, SDL_Surface* source, SDL_Surface* destination,
 void window_exit() {
     // free surfaces
     for (auto surface : surface_array) { SDL_FreeSurface(surface); }
+    screen_camera.free();
 
     // free cursors
     for (auto cursor : cursor_array) { SDL_FreeCursor(cursor); }
 
+    // the window surface is freed by SDL_Quit, the frame it was scaled from is not
+    if (screen != window_surface) { SDL_FreeSurface(screen); }
+
     // quit SDL
     SDL_Quit();
 }
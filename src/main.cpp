@@ -1,7 +1,27 @@
 #include "SDL/SDL.h"
+#include "fixed.hpp"
 #include "input.hpp"
+#include "alloc.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+#include "schedule.hpp"
+#include "soak.hpp"
+#include "scale.hpp"
+#include "camera.hpp"
+#include "palette.hpp"
 #include "window.hpp"
+#include "kinetic.hpp"
+#include "export.hpp"
+#include "render.hpp"
+#include "rewind.hpp"
+#include "scene.hpp"
+#include "spectate.hpp"
 #include "game.hpp"
+#include "lookahead.hpp"
+#include "scenario.hpp"
+#include "control.hpp"
+#include "autoplay.hpp"
+#include "boards.hpp"
 #include <iostream>
 #include <vector>
 
@@ -12,125 +32,193 @@ int main (int argc, char* argv[]) {
     arguments_init(argc, argv, parameters);
 
     // load game state
-    state game_state {
+    simulation sim;
+    sim.game_state = {
         .current_level = parameters.LEVEL_SELECT,
         .current_lives = parameters.STARTING_LIVES,
         .current_percentage = 0,
         .quit = false,
+        .show_stats = false,
+        .frame = 0,
+        .trajectory_hash = TRAJECTORY_HASH_SEED,
     };
 
+    // move balls in fixed point
+    physics_fixed = parameters.FIXED_PHYSICS;
+
+    // move balls between predicted collisions
+    physics_kinetic = parameters.KINETIC_PHYSICS;
+
+    // record engine counters for export
+    if (!parameters.STATS_FILE.empty()) { stats.record(parameters.FRAME_LIMIT); }
+
+    // record trace zones for export
+    if (!parameters.TRACE_FILE.empty()) { trace.enable(); }
+
+    // attribute heap allocations to trace zones
+    if (parameters.ALLOC_CHECK) { allocations.enable(); }
+
+    // spread deferrable work across frames
+    if (parameters.FRAME_BUDGET > 0) { scheduler.enable(parameters.FRAME_BUDGET); }
+
+    // measure cpu usage
+    if (parameters.CPU_REPORT) { cpu.enable(); }
+
+    // watch unattended play
+    if (parameters.AUTOPLAY > 0) { soak.enable(parameters.AUTOPLAY, parameters.FRAME_BUDGET > 0 ? parameters.FRAME_BUDGET : 1000 / FPS_CAP); }
+
     // init timers
-    timer fps;
-    timer ball_timer;
-    timer level_timer;
-    timer quit_timer;
+    timer frame_timer;
     unsigned int start_time;
 
     // initialize SDL window
-    window_init();
+    window_init(parameters);
+
+    // step timers by frame when running headless or exporting, so exports do not depend on wall time
+    clock_fixed = parameters.HEADLESS || !parameters.EXPORT_FILE.empty();
 
     // load files
     load_files(parameters);
     digits_init();
+    if (!screen_camera.init()) { std::cerr << "error: could not scale sprites for zooming, the view stays unzoomed" << std::endl; }
+
+    // init frame export
+    frame_encoder encoder;
+    if (!parameters.EXPORT_FILE.empty()) {
+        SDL_Surface* exported = (parameters.BOARDS > 1) ? window_surface : screen;
+        if (!encoder.start(parameters.EXPORT_FILE, exported->w, exported->h)) {
+            std::cerr << "error: could not open export file " << parameters.EXPORT_FILE;
+            if (parameters.EXPORT_FILE.find('%') != std::string::npos) { std::cerr << ", a ppm sequence takes a single %d or %0Nd"; }
+            std::cerr << std::endl;
+            window_exit();
+            std::exit(1);
+        }
+    }
+
+    // play tiled boards and quit
+    if (parameters.BOARDS > 1) {
+        const bool played = boards_session(parameters, encoder);
+        encoder.stop();
+        window_exit();
+        return played ? exit_reports(parameters, encoder) : 1;
+    }
+
+    // init renderer
+    renderer display;
+    if (encoder.is_running()) { display.record(&encoder); }
 
     // load buttons
-    std::vector<std::vector<button>> grid;
-    button_init(grid);
-
-    // load walls
-    std::vector<wall> walls_list;
-    orientation wall_orientation = orientation::vertical;
-    std::vector<button> walls_to_build_black;
-    std::vector<button> walls_to_build_white;
-    std::vector<button> walls_black_buffer;
-    std::vector<button> walls_white_buffer;
-    bool walls_black_building = false;
-    bool walls_white_building = false;
-
-    // load balls
-    std::vector<ball> balls_list;
-    ball_init(parameters, game_state, balls_list);
+    button_init(sim.grid);
+
+    // init background level loading
+    level_loader loader;
+
+    // reserve level storage
+    level_storage_init(sim.grid, sim.walls_list, sim.walls_to_build_black, sim.walls_to_build_white, sim.walls_black_buffer, sim.walls_white_buffer, sim.balls_list);
+
+    // spawn the starting level, or load it from a scenario
+    scenario script;
+    std::size_t next_input = 0;
+    if (parameters.SCENARIO_FILE.empty()) {
+        ball_init(parameters, sim.game_state, sim.balls_list);
+    } else {
+        std::string error;
+        if (!load_scenario(parameters.SCENARIO_FILE, script, error)) {
+            std::cerr << "error: " << error << std::endl;
+            display.stop();
+            encoder.stop();
+            window_exit();
+            std::exit(1);
+        }
+        apply_scenario(script, sim);
+    }
+
+    // start the clock queued walls are built on
+    sim.build_timer.start();
+
+    // keep recent ticks for scrubbing back while paused
+    rewind_buffer history;
+    history.init(parameters.REWIND_MEGABYTES, std::max<std::size_t>(sim.balls_list.capacity(), MAX_LEVEL), sim.walls_list.capacity());
+
+    // size snapshots for a full board, then start rendering
+    display.reserve(sim.walls_list.capacity(), std::max<std::size_t>(sim.balls_list.capacity(), MAX_LEVEL));
+    if (parameters.RENDER_THREAD) { display.start(); }
+
+    // benchmark forking and quit
+    if (parameters.FORK_BENCHMARK > 0) {
+        sim.ball_timer.start();
+        fork_benchmark(parameters, sim, parameters.FORK_BENCHMARK);
+        display.stop();
+        encoder.stop();
+        window_exit();
+        return 0;
+    }
+
+    // answer control commands and quit
+    if (!parameters.CONTROL.empty()) {
+        const bool served = control_session(parameters, sim);
+        if (!served) { std::cerr << "error: could not open control socket " << parameters.CONTROL << std::endl; }
+        display.stop();
+        encoder.stop();
+        window_exit();
+        return served ? 0 : 1;
+    }
+
+    // publish frames for spectators
+    spectator_feed feed;
+    if (!parameters.SPECTATE.empty() && !feed.open(parameters.SPECTATE, PLAYFIELD_COLS, PLAYFIELD_ROWS, GRID_DIM, balls_surface->w, std::max<std::size_t>(sim.balls_list.capacity(), MAX_LEVEL))) {
+        std::cerr << "error: could not open spectator feed " << parameters.SPECTATE << std::endl;
+    }
+
+    // init scenes
+    scene_scheduler scenes;
+    scene_context context{.parameters = parameters, .sim = sim, .loader = loader, .history = history, .scenes = scenes};
+    autoplay_agent agent;
 
     // GAME LOOP
     try {
-        while (!game_state.quit) {
-            
-            // GAME RUNNING
-            if (!fps.is_paused()) {
-                
-                // INITIALIZATION
-                fps.start();
-                start_time = SDL_GetTicks();
-
-                // clear frame
-                if (SDL_FillRect(screen, NULL, 0x000000) == -1) { throw std::runtime_error("SDL failed"); };
-                if (SDL_BlitSurface(background_surface, NULL, screen, NULL) == -1) { throw std::runtime_error("SDL failed"); }
-
-                // set cursor
-                SDL_SetCursor((wall_orientation == orientation::vertical) ? cursor_vertical : cursor_horizontal);
-
-                // set HUD
-                hud_handle(game_state);
-
-                // EVENTS LOOP
-                while (SDL_PollEvent(&event)) {
-
-                    // check for pause
-                    pause_handle(fps, ball_timer, walls_to_build_black, walls_to_build_white);
-                    if (!fps.is_paused()) { 
-
-                        // handle button
-                        button_handle(grid, walls_list, walls_to_build_black, walls_to_build_white, wall_orientation);
-
-                        // handle orientation
-                        orientation_handle(wall_orientation);
-                        
-                    }
-
-                    // check for quit
-                    if (event.type == SDL_QUIT) { game_state.quit = true; }
-
-                }
-
-                // LOGIC
-                if (!fps.is_paused()) {
-                    
-                    // build black and white walls
-                    build_walls(parameters, grid, walls_list, walls_to_build_black, walls_black_buffer, walls_black_building);
-                    build_walls(parameters, grid, walls_list, walls_to_build_white, walls_white_buffer, walls_white_building);
-
-                    // handle walls
-                    wall_handle(walls_list);
-                    
-                    // handle balls
-                    ball_handle(game_state, balls_list, ball_timer, walls_list, walls_to_build_black, walls_to_build_white, walls_black_buffer, walls_white_buffer);
-
-                    // update game state
-                    update_game_state(parameters, game_state, fps, level_timer, quit_timer, grid, walls_list, walls_to_build_black, walls_to_build_white, walls_black_buffer, walls_white_buffer, walls_black_building, walls_white_building, balls_list, ball_timer);
-                }
-
-            // GAME PAUSED
-            } else {
-                
-                // EVENTS LOOP
-                while (SDL_PollEvent(&event)) {
-                    
-                    // check for unpause
-                    pause_handle(fps, ball_timer, walls_to_build_black, walls_to_build_white);
-
-                    // check for quit
-                    if (event.type == SDL_QUIT) { game_state.quit = true; }
-                    
-                }
-            }
+        scenes.start(run_scenes(context));
+        while (!sim.game_state.quit && scenes.is_running()) {
+            scheduler.begin_frame();
+            soak.begin_frame();
+            frame_timer.start();
+            start_time = SDL_GetTicks();
+
+            // frames that stay in gameplay on the same level are steady state
+            const scene scene_at_start = scenes.current_scene();
+            const unsigned int level_at_start = sim.game_state.current_level;
+            cpu.enter(scene_activity(scene_at_start));
+
+            // play scripted input
+            scenario_input_handle(script, next_input, sim, scene_at_start != scene::playing);
+
+            // play unattended
+            if (parameters.AUTOPLAY > 0) { agent.play(context); }
+
+            // run the scene and any timed actions due
+            scenes.run_frame();
+            spectate_handle(feed, sim.game_state, sim.walls_list, sim.balls_list, scenes.current_scene());
 
             // RENDERING
-            if (!level_timer.is_started()) {
-                if (SDL_Flip(screen) == -1 ) { throw std::runtime_error("SDL failed"); }
+            // skipped on frames without time to spare, but never while exporting
+            if (!sim.game_state.quit && scheduler.admit(TASK_RENDER, encoder.is_running())) {
+                capture_snapshot(display.back(), sim.game_state, sim.walls_list, sim.balls_list, context.screen_overlay);
+
+                // show the scrubbed tick instead, without the overlay covering it
+                if (history.is_scrubbing() && history.load(display.back())) { display.back().screen_overlay = overlay::none; }
+                if (!display.present()) { throw std::runtime_error("SDL failed"); }
+                scheduler.done(TASK_RENDER);
             }
+            frame_handle(parameters, sim.game_state);
+
+            // check steady state frames for heap allocations
+            const bool steady = (scene_at_start == scene::playing) && (scenes.current_scene() == scene::playing) && (sim.game_state.current_level == level_at_start);
+            allocations.check_frame(steady, sim.game_state.frame, stats.last_frame()[HEAP_ALLOCATIONS]);
+            soak.end_frame(sim, steady);
 
-            // display and cap fps
-            fps_handle(fps, start_time);
+            // display and cap fps, or wait for an event while nothing moves, unless headless, autoplaying or a script is still playing
+            const bool idle = scenes.is_idle() && !parameters.HEADLESS && (parameters.AUTOPLAY == 0) && !scenario_input_pending(script, next_input);
+            fps_handle(parameters, frame_timer, start_time, idle);
 
         }
 
@@ -138,12 +226,25 @@ int main (int argc, char* argv[]) {
     } catch (const std::runtime_error& e) {
         std::cerr << e.what() << std::endl;
         std::cerr << SDL_GetError() << std::endl;
+        loader.stop();
+        feed.close();
+        display.stop();
+        encoder.stop();
         window_exit();
         std::exit(1);
     }
 
     // clean up and quit
+    loader.stop();
+    feed.close();
+    display.stop();
+    encoder.stop();
     window_exit();
 
-    return 0;
+    // report trajectory hash, equal hashes mean bit identical runs
+    if (parameters.FIXED_PHYSICS) {
+        std::cout << "trajectory hash: " << std::hex << sim.game_state.trajectory_hash << std::dec << " after " << sim.game_state.frame << " frames" << std::endl;
+    }
+
+    return exit_reports(parameters, encoder);
 }
@@ -0,0 +1,64 @@
+#include "spectate.hpp"
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+
+// SPECTATOR
+// example viewer for the spectator feed, draws the board in the terminal as the game plays
+//     jezzball_spectate [$name (=/jezzball)] [-once]
+// '#' is a built wall, 'o' a cell with a ball in it, -once prints the latest frame and quits
+const std::chrono::milliseconds SPECTATE_REFRESH(100);
+
+void draw_frame(const spectator_frame &frame, std::string &out) {
+    out.assign(frame.cells.size() + frame.rows, ' ');
+    for (std::uint32_t row = 0; row < frame.rows; ++row) {
+        for (std::uint32_t col = 0; col < frame.columns; ++col) {
+            out[row * (frame.columns + 1) + col] = (frame.cells[col * frame.rows + row] == SPECTATE_OPEN) ? '.' : '#';
+        }
+        out[row * (frame.columns + 1) + frame.columns] = '\n';
+    }
+
+    // balls by the cell under their centre
+    const int half = frame.ball_pixels / 2;
+    for (const std::pair<std::int16_t, std::int16_t> &position : frame.balls) {
+        const int col = (position.first + half) / int(frame.cell_pixels);
+        const int row = (position.second + half) / int(frame.cell_pixels);
+        if (col >= 0 && col < int(frame.columns) && row >= 0 && row < int(frame.rows)) { out[row * (frame.columns + 1) + col] = 'o'; }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string name = "/jezzball";
+    bool once = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "-once") { once = true; }
+        else { name = arg; }
+    }
+
+    spectator_reader reader;
+    if (!reader.open(name)) {
+        std::cerr << "error: no spectator feed at " << name << ", start the game with -spectate" << name << std::endl;
+        return 1;
+    }
+
+    spectator_frame frame;
+    std::string board;
+    std::uint64_t frames = 0, skipped = 0;
+    while (reader.is_live()) {
+        if (reader.read(frame)) {
+            ++frames;
+            skipped += frames > 1 ? frame.skipped : 0;
+            draw_frame(frame, board);
+            if (!once) { std::cout << "\033[H\033[2J"; }
+            std::cout << "level " << frame.hud.level << "  lives " << frame.hud.lives << "  captured " << int(frame.hud.percentage) << "%  balls " << frame.balls.size() << "  " << spectator_status_names[static_cast<int>(frame.hud.status)] << std::endl;
+            std::cout << board;
+            std::cout << "frame " << frame.hud.frame << ", " << frame.changed.size() << " cells changed, " << skipped << " frames skipped" << std::endl;
+            if (once) { return 0; }
+        }
+        std::this_thread::sleep_for(SPECTATE_REFRESH);
+    }
+    std::cout << "the game closed the feed" << std::endl;
+    return 0;
+}